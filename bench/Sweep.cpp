@@ -0,0 +1,122 @@
+#include <QFile>
+#include <QStringList>
+#include <QRegExp>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QtConcurrent>
+
+#include "Sweep.h"
+#include "HarmonicsCreator.h"
+
+using namespace Tide;
+
+class Tide::Sweep::Job {
+public:
+    Job(): station(0), config(0), seconds(0) {}
+    int station;
+    int config;
+    HarmonicsCreator::Fit result;
+    double seconds;
+};
+
+Sweep::Sweep(const Interval& holdout):
+    m_Holdout(holdout)
+{
+    m_Grid.append(Configuration());
+}
+
+Sweep::~Sweep() {
+    qDeleteAll(m_Data);
+}
+
+bool Sweep::readGrid(const QString& path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << path << ": cannot open";
+        return false;
+    }
+    QTextStream in(&f);
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+        QStringList parts = line.split(QRegExp("\\s+"));
+        if (parts.size() < 2) {
+            qDebug() << line << ": no values";
+            return false;
+        }
+        QString key = parts.takeFirst();
+        QList<Configuration> grid;
+        foreach (const Configuration& c, m_Grid) {
+            foreach (const QString& v, parts) {
+                bool ok;
+                double value = v.toDouble(&ok);
+                if (!ok) {
+                    qDebug() << key << v << ": invalid value";
+                    return false;
+                }
+                grid.append(c);
+                grid.last().append(qMakePair(key, QVariant(value)));
+            }
+        }
+        m_Grid = grid;
+    }
+    return true;
+}
+
+// Samples are materialized lazily from the database: build the fitted
+// patch here, the workers only read the shared array.
+void Sweep::load(int station_id) {
+    PatchIterator* data = new PatchIterator(station_id);
+    if (data->lastPatch()) {
+        data->samples();
+    }
+    m_Data[station_id] = data;
+}
+
+void Sweep::fit(Job& job) const {
+    HarmonicsCreator hc;
+    hc.config("parallel", false);
+    foreach (const Configuration::value_type& kv, m_Grid[job.config]) {
+        hc.config(kv.first, kv.second);
+    }
+    PatchIterator data(*m_Data[job.station]);
+    QElapsedTimer timer;
+    timer.start();
+    job.result = hc.fit(data, m_Holdout);
+    job.seconds = timer.elapsed() / 1000.;
+}
+
+void Sweep::run(const QList<int>& station_ids, QTextStream& out) {
+    QVector<Job> jobs;
+    foreach (int station_id, station_ids) {
+        if (!m_Data.contains(station_id)) load(station_id);
+        for (int config = 0; config < m_Grid.size(); config++) {
+            Job job;
+            job.station = station_id;
+            job.config = config;
+            jobs.append(job);
+        }
+    }
+
+    qDebug() << "sweeping" << jobs.size() << "fits";
+    QtConcurrent::blockingMap(jobs, [this] (Job& job) {fit(job);});
+
+    out << "station\tconfig\tmodes\tseconds\tbytes\trms\tmax\tholdout_rms\tholdout_size\n";
+    foreach (const Job& job, jobs) {
+        QStringList config;
+        foreach (const Configuration::value_type& kv, m_Grid[job.config]) {
+            config << QString("%1=%2").arg(kv.first).arg(kv.second.toString());
+        }
+        const HarmonicsCreator::Fit& r = job.result;
+        out << job.station << '\t'
+            << config.join(',') << '\t'
+            << r.coeffs.modes.size() << '\t'
+            << job.seconds << '\t'
+            << r.designBytes << '\t'
+            << r.residual.rms << '\t'
+            << r.residual.max << '\t'
+            << r.holdoutRms << '\t'
+            << r.holdoutSize << '\n';
+    }
+    out.flush();
+}
@@ -0,0 +1,58 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QString>
+#include <QVariant>
+#include <QTextStream>
+
+#include "Interval.h"
+#include "PatchIterator.h"
+
+namespace Tide {
+
+// Headless grid search over HarmonicsCreator configurations. Every
+// (station, configuration) pair is fitted by its own creator instance on
+// the global thread pool; the readings are loaded up front on the calling
+// thread since the database connection is not shared.
+//
+// The grid file has one line per key followed by the values to try:
+//
+//   resolutioncut 0.85 0.9 0.95
+//   amplitudecut 0.005 0.01
+//
+// and the sweep runs the cartesian product of all lines.
+class Sweep {
+public:
+
+    typedef QList<QPair<QString, QVariant>> Configuration;
+
+    Sweep(const Interval& holdout);
+    ~Sweep();
+
+    bool readGrid(const QString& path);
+    void run(const QList<int>& station_ids, QTextStream& out);
+
+private:
+
+    Sweep(const Sweep&);
+    Sweep& operator=(const Sweep&);
+
+    class Job;
+
+    void load(int station_id);
+    void fit(Job& job) const;
+
+private:
+
+    Interval m_Holdout;
+    QList<Configuration> m_Grid;
+    QHash<int, PatchIterator*> m_Data;
+
+};
+
+}
+
+#endif // SWEEP_H
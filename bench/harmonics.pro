@@ -1,6 +1,6 @@
 TEMPLATE = app
 
-QT += sql xml network widgets
+QT += sql xml network widgets concurrent
 CONFIG += c++11
 
 TOP = ..
@@ -10,17 +10,17 @@ FILES = $${TOP}/files
 
 SOURCES += $${TSRC}/Angle.cpp $${TSRC}/Amplitude.cpp $${TSRC}/Coordinates.cpp \
     $${TSRC}/Interval.cpp $${TSRC}/Timestamp.cpp $${TSRC}/Speed.cpp $${TSRC}/Year.cpp \
-    $${TSRC}/RunningSet.cpp $${TSRC}/Complex.cpp $${TSRC}/HarmonicsCreator.cpp \
-    $${TSRC}/Database.cpp $${TSRC}/Address.cpp $${TSRC}/PatchIterator.cpp $${TSRC}/PointsWindow.cpp \
-    $${TSRC}/Station.cpp $${TSRC}/Skycal.cpp main.cpp
+    $${TSRC}/RunningSet.cpp $${TSRC}/Complex.cpp $${TSRC}/HarmonicsCreator.cpp $${TSRC}/ModeRegistry.cpp \
+    $${TSRC}/Database.cpp $${TSRC}/Address.cpp $${TSRC}/PatchIterator.cpp $${TSRC}/Readings.cpp $${TSRC}/SampleCache.cpp $${TSRC}/StationInfo.cpp $${TSRC}/StationHandle.cpp $${TSRC}/PointsWindow.cpp \
+    $${TSRC}/Station.cpp $${TSRC}/Skycal.cpp Sweep.cpp main.cpp
 
 HEADERS += $${TSRC}/Amplitude.h $${TSRC}/ConstituentSet.h $${TSRC}/Speed.h $${TSRC}/Year.h \
     $${TSRC}/Angle.h $${TSRC}/Coordinates.h $${TSRC}/Interval.h $${TSRC}/Timestamp.h \
-    $${TSRC}/RunningSet.h $${TSRC}/HarmonicsCreator.h $${TSRC}/Complex.h \
-    $${TSRC}/Database.h $${TSRC}/Address.h $${TSRC}/PatchIterator.h $${TSRC}/PointsWindow.h \
-    $${TSRC}/Station.h $${TSRC}/Skycal.h
+    $${TSRC}/RunningSet.h $${TSRC}/HarmonicsCreator.h $${TSRC}/ModeRegistry.h $${TSRC}/Complex.h \
+    $${TSRC}/Database.h $${TSRC}/Address.h $${TSRC}/PatchIterator.h $${TSRC}/Readings.h $${TSRC}/SampleCache.h $${TSRC}/StationInfo.h $${TSRC}/StationHandle.h $${TSRC}/PointsWindow.h \
+    $${TSRC}/Station.h $${TSRC}/Skycal.h Sweep.h
 
-RESOURCES += $${TOP}/harmonics.qrc
+include($${FILES}/congen.pri)
 
 LIBS += -lqwt6-qt5 -lfftw3
 
@@ -1,12 +1,60 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include <QDebug>
 
 #include "HarmonicsCreator.h"
+#include "PatchIterator.h"
 #include "PointsWindow.h"
+#include "Sweep.h"
 
+// harmonics sweep grid holdout_days station_id [station_id ...]
+static int sweep(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    bool ok;
+    if (argc < 5) return 1;
+    double days = QString(argv[3]).toDouble(&ok);
+    if (!ok) return 1;
+    QList<int> station_ids;
+    for (int k = 4; k < argc; k++) {
+        int station_id = QString(argv[k]).toInt(&ok);
+        if (!ok) return 1;
+        station_ids.append(station_id);
+    }
+    Tide::Sweep s(Tide::Interval::fromSeconds(Tide::interval_rep_t(days * 24 * 3600)));
+    if (!s.readGrid(QString(argv[2]))) return 1;
+    QTextStream out(stdout);
+    s.run(station_ids, out);
+    return 0;
+}
+
+// harmonics bridge
+// Gap of four steps from 1.0 (last reading) to 5.0 (first reading of the
+// next epoch): the bridge must rise by 1.0 per step.
+static int bridge()
+{
+    const double ramp[] = {1.0, 2.0, 3.0, 4.0, 5.0};
+    int failed = 0;
+    for (int k = 0; k < 5; k++) {
+        double v = Tide::PatchIterator::bridge(1.0, 5.0, k / 4.0);
+        if (qAbs(v - ramp[k]) > 1e-12) {
+            qWarning() << "bridge step" << k << "got" << v << "expected" << ramp[k];
+            failed++;
+        }
+    }
+    qDebug() << "bridge" << (failed ? "FAILED" : "ok");
+    return failed ? 1 : 0;
+}
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && QString(argv[1]) == "sweep") {
+        return sweep(argc, argv);
+    }
+    if (argc > 1 && QString(argv[1]) == "bridge") {
+        return bridge();
+    }
+
     QApplication app(argc, argv);
     bool ok;
     if (argc < 2) return 1;
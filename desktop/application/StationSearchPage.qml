@@ -41,7 +41,7 @@ Rectangle {
             top: searchField.bottom
             bottom: backButton.top
         }
-        visible: locationListView.count == 0
+        visible: locationListView.count == 0 && !stationModel.loading
         horizontalAlignment: Text.AlignHCenter
         verticalAlignment: Text.AlignVCenter
         //% "Search and select new location"
@@ -49,6 +49,10 @@ Rectangle {
         font.pixelSize: Theme.fontSizeLarge
     }
 
+    BusyIndicator {
+        anchors.centerIn: placeHolder
+        running: stationModel.loading
+    }
 
     ListView {
         id: locationListView
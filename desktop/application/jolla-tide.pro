@@ -1,6 +1,6 @@
 TEMPLATE = app
 
-QT += qml quick sql xml widgets dbus
+QT += qml quick sql xml widgets dbus concurrent
 CONFIG += c++11
 TRANSLATIONS += jolla-tide_en.ts
 
@@ -13,17 +13,17 @@ DBUS_INTERFACES += $${FILES}/stationupdater.xml
 
 SOURCES += $${TSRC}/Angle.cpp $${TSRC}/Amplitude.cpp $${TSRC}/Coordinates.cpp \
     $${TSRC}/Interval.cpp $${TSRC}/Timestamp.cpp $${TSRC}/Speed.cpp $${TSRC}/Year.cpp \
-    $${TSRC}/RunningSet.cpp $${TSRC}/Complex.cpp $${TSRC}/HarmonicsCreator.cpp \
-    $${TSRC}/Database.cpp $${TSRC}/Address.cpp $${TSRC}/PatchIterator.cpp $${TSRC}/PointsWindow.cpp \
-    $${TSRC}/Station.cpp $${TSRC}/Skycal.cpp $${TSRC}/StationProvider.cpp $${TSRC}/TideEvent.cpp $${TSRC}/ActiveStations.cpp \
+    $${TSRC}/RunningSet.cpp $${TSRC}/Complex.cpp $${TSRC}/HarmonicsCreator.cpp $${TSRC}/ModeRegistry.cpp \
+    $${TSRC}/Database.cpp $${TSRC}/Address.cpp $${TSRC}/PatchIterator.cpp $${TSRC}/Readings.cpp $${TSRC}/SampleCache.cpp $${TSRC}/StationInfo.cpp $${TSRC}/StationHandle.cpp $${TSRC}/Plugins.cpp $${TSRC}/PointsWindow.cpp \
+    $${TSRC}/Station.cpp $${TSRC}/Skycal.cpp $${TSRC}/StationProvider.cpp $${TSRC}/StationIndex.cpp $${TSRC}/StationGrid.cpp $${TSRC}/Snapshot.cpp $${TSRC}/TideEvent.cpp $${TSRC}/ActiveStations.cpp \
     $${TSRC}/Events.cpp $${TSRC}/WebFactory.cpp $${TSRC}/TideForecast.cpp $${TSRC}/Factories.cpp \
     main.cpp
 
 HEADERS += $${TSRC}/Amplitude.h $${TSRC}/ConstituentSet.h $${TSRC}/Speed.h $${TSRC}/Year.h \
     $${TSRC}/Angle.h $${TSRC}/Coordinates.h $${TSRC}/Interval.h $${TSRC}/Timestamp.h \
-    $${TSRC}/RunningSet.h $${TSRC}/HarmonicsCreator.h $${TSRC}/Complex.h \
-    $${TSRC}/Database.h $${TSRC}/Address.h $${TSRC}/PatchIterator.h $${TSRC}/PointsWindow.h \
-    $${TSRC}/Station.h $${TSRC}/Skycal.h $${TSRC}/StationProvider.h $${TSRC}/TideEvent.h $${TSRC}/StationFactory.h \
+    $${TSRC}/RunningSet.h $${TSRC}/HarmonicsCreator.h $${TSRC}/ModeRegistry.h $${TSRC}/Complex.h \
+    $${TSRC}/Database.h $${TSRC}/Address.h $${TSRC}/PatchIterator.h $${TSRC}/Readings.h $${TSRC}/SampleCache.h $${TSRC}/StationInfo.h $${TSRC}/StationHandle.h $${TSRC}/Plugins.h $${TSRC}/PointsWindow.h \
+    $${TSRC}/Station.h $${TSRC}/Skycal.h $${TSRC}/StationProvider.h $${TSRC}/StationIndex.h $${TSRC}/StationGrid.h $${TSRC}/Snapshot.h $${TSRC}/TideEvent.h $${TSRC}/StationFactory.h \
     $${TSRC}/ActiveStations.h $${TSRC}/Events.h $${TSRC}/WebFactory.h $${TSRC}/TideForecast.h $${TSRC}/Factories.h
 
 #lupdate_only {
@@ -34,7 +34,9 @@ HEADERS += $${TSRC}/Amplitude.h $${TSRC}/ConstituentSet.h $${TSRC}/Speed.h $${TS
 
 DEFINES += QT_STATICPLUGIN
 
-RESOURCES += qml.qrc translations.qrc $${TOP}/icons.qrc $${TOP}/harmonics.qrc
+include($${FILES}/congen.pri)
+
+RESOURCES += qml.qrc translations.qrc $${TOP}/icons.qrc
 
 LIBS += -lxml2 -lqwt6-qt5 -lfftw3
 
@@ -1,13 +1,13 @@
 #include <QApplication>
 #include <QQmlApplicationEngine>
 #include <QtPlugin>
-#include <QPluginLoader>
 #include <QQmlContext>
 #include <QtQml>
 #include <QDebug>
 #include <QTranslator>
 
 #include "StationProvider.h"
+#include "Plugins.h"
 #include "TideForecast.h"
 #include "ActiveStations.h"
 #include "Events.h"
@@ -23,31 +23,14 @@ int main(int argc, char *argv[])
     qDebug() << translator.load("jolla-tide_en", ":/");
     app.installTranslator(&translator);
 
-    QList<Tide::StationFactory*> factories;
-    foreach (QObject* plugin, QPluginLoader::staticInstances()) {
-        Tide::StationFactory* factory = qobject_cast<Tide::StationFactory*>(plugin);
-        if (factory) {
-            factories.append(factory);
-        }
-    }
-
-    QDir pluginsDir(qApp->applicationDirPath());
-    pluginsDir.cd("plugins");
-
-    foreach (QString fileName, pluginsDir.entryList(QDir::Files)) {
-        QPluginLoader loader(pluginsDir.absoluteFilePath(fileName));
-        Tide::StationFactory* factory = qobject_cast<Tide::StationFactory*>(loader.instance());
-        if (factory) {
-            factories.append(factory);
-        }
-    }
+    Tide::Plugins plugins(QDir(qApp->applicationDirPath()).filePath("plugins"));
 
     qmlRegisterSingletonType(QUrl("qrc:///Theme.qml"), "net.kvanttiapina.tide.theme", 1, 0, "Theme");
 
     QQmlApplicationEngine engine;
     QQmlContext *ctxt = engine.rootContext();
 
-    Tide::Factories factoryModel(factories);
+    Tide::Factories factoryModel(&plugins);
     ctxt->setContextProperty("factoryModel", &factoryModel);
 
     Tide::StationProvider stations(&factoryModel);
@@ -1,12 +1,13 @@
 #include <QCoreApplication>
 #include <QtPlugin>
-#include <QPluginLoader>
+#include <QDir>
 #include <QDebug>
 #include <QtDBus/QDBusConnection>
 
 #include "TideForecast.h"
 #include "stationupdater_adaptor.h"
 #include "Updater.h"
+#include "Plugins.h"
 
 Q_IMPORT_PLUGIN(TideForecast)
 
@@ -15,26 +16,10 @@ int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
 
-    QList<Tide::StationFactory*> factories;
-    foreach (QObject* plugin, QPluginLoader::staticInstances()) {
-        Tide::StationFactory* factory = qobject_cast<Tide::StationFactory*>(plugin);
-        if (factory) {
-            factories.append(factory);
-        }
-    }
+    // the updater needs every catalog, load all factories
+    Tide::Plugins plugins(QDir(qApp->applicationDirPath()).filePath("plugins"));
 
-    QDir pluginsDir(qApp->applicationDirPath());
-    pluginsDir.cd("plugins");
-
-    foreach (QString fileName, pluginsDir.entryList(QDir::Files)) {
-        QPluginLoader loader(pluginsDir.absoluteFilePath(fileName));
-        Tide::StationFactory* factory = qobject_cast<Tide::StationFactory*>(loader.instance());
-        if (factory) {
-            factories.append(factory);
-        }
-    }
-
-    Tide::Updater* updater = new Tide::Updater(factories);
+    Tide::Updater* updater = new Tide::Updater(plugins.instances());
     new ManagerAdaptor(updater);
     QDBusConnection conn = QDBusConnection::sessionBus();
     conn.registerObject("/Updater", updater);
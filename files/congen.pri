@@ -0,0 +1,12 @@
+# Constituent table of ModeRegistry, generated from the congen input
+
+CONGEN_INPUT = $$PWD/congen_input.txt
+
+congen.input = CONGEN_INPUT
+congen.output = congen_table.cpp
+congen.commands = python3 $$PWD/congen.py ${QMAKE_FILE_IN} > ${QMAKE_FILE_OUT}
+congen.depends = $$PWD/congen.py
+congen.variable_out = SOURCES
+QMAKE_EXTRA_COMPILERS += congen
+
+OTHER_FILES += $$PWD/congen.py
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# Generate the static constituent table of ModeRegistry from congen input.
+#
+#   congen.py congen_input.txt > congen_table.cpp
+#
+# Speeds are derived from the astronomical polynomials, as ModeRegistry
+# used to do at application startup, but at the fixed J2000 epoch so that
+# every build of the same input produces the same table.
+
+import hashlib
+import math
+import sys
+
+daysPerJulianCentury = 36525.
+hoursPerJulianCentury = 876600.
+secondsPerJulianCentury = 3155760000.
+
+# 1899-12-31 12:00 GMT
+epoch = -2209032000
+
+# 2000-01-01 12:00 GMT, where the speeds are evaluated
+j2000 = 946728000
+
+
+def derivative(t0, t1, t2, t3, c):
+    return t1 + 2 * t2 * c + 3 * t3 * c * c
+
+
+class T(object):
+
+    def __init__(self, posix):
+        c = (posix - epoch) / secondsPerJulianCentury
+        self.v = [
+            derivative(0, daysPerJulianCentury*360, 0, 0, c),
+            derivative(270 + 26./60 + 14.72/3600, 1336*360 + 1108411.2/3600, 9.09/3600, .0068/3600, c),
+            derivative(279 + 41./60 + 48.04/3600, 129602768.13/3600, 1.089/3600, 0, c),
+            derivative(334 + 19./60 + 40.87/3600, 11*360 + 392515.94/3600, -37.24/3600, -.045/3600, c),
+            derivative(281 + 13./60 + 15./3600, 6189.03/3600, 1.63/3600, .012/3600, c),
+        ]
+
+    def speed(self, n):
+        return sum(v * k for v, k in zip(self.v, n)) / hoursPerJulianCentury
+
+
+# O1 K1 P1 M2 S2 N2 L2 K2 Q1 NU2 S1 M1-DUTCH LDA2
+base = [(1,-2,1,0,0), (1,0,1,0,0), (1,0,-1,0,0), (2,-2,2,0,0),
+        (2,0,0,0,0), (2,-3,2,1,0), (2,-1,2,-1,0), (2,0,2,0,0),
+        (1,-3,1,1,0), (2,-3,4,-1,0), (1,0,0,0,0), (1,-1,1,1,0),
+        (2,-1,0,1,0)]
+
+types = ("Basic", "Doodson", "Compound")
+
+
+def same(a, b):
+    den = 0.5 * (a + b)
+    if den == 0:
+        return True
+    return abs(a - b) / den < 0.0000001
+
+
+def parse(lines, t):
+    modes = []
+    for line in lines:
+        if line.strip().startswith('#'):
+            continue
+        parts = line.split()
+        if len(parts) < 2 or parts[1] not in types:
+            continue
+        if parts[1] == "Compound":
+            muls = [int(p) for p in parts[2:]]
+            n = [sum(m * b[i] for m, b in zip(muls, base)) for i in range(5)]
+            dph = sum(m * t.speed(b) for m, b in zip(muls, base))
+        else:
+            n = [int(p) for p in parts[2:7]]
+            dph = t.speed(n)
+            if parts[0] == "M1":
+                dph += t.v[3] / hoursPerJulianCentury
+        if dph < 0:
+            sys.exit("%s: negative speed" % parts[0])
+        if any(same(dph, m[2]) for m in modes):
+            continue
+        modes.append((parts[0], n, dph))
+    modes.sort(key=lambda m: m[2])
+    return [m for m in modes if m[2] != 0]
+
+
+def main():
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    lines = data.decode('latin-1').splitlines()
+    modes = [("Z0", [0, 0, 0, 0, 0], 0.0)] + parse(lines, T(j2000))
+    entries = ['    {"%s", {%s}, %r},' % (name, ", ".join("%d" % k for k in n), dph)
+               for name, n, dph in modes]
+    # the version follows the generated speeds, not only the input
+    version = hashlib.md5(data + "\n".join(entries).encode('latin-1')).hexdigest()
+
+    print("// Generated by congen.py from congen_input.txt, do not edit")
+    print()
+    print('#include "ModeRegistry.h"')
+    print()
+    print("using namespace Tide;")
+    print()
+    print('const char* const ModeRegistry::TableVersion = "%s";' % version)
+    print()
+    print("const int ModeRegistry::TableSize = %d;" % len(modes))
+    print()
+    print("const ModeRegistry::Entry ModeRegistry::Table[] = {")
+    for entry in entries:
+        print(entry)
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
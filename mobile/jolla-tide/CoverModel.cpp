@@ -44,20 +44,25 @@ void CoverModel::updateCover() {
         QString m = m_Stations->data(top, ActiveStations::MarkRole).toString();
         Amplitude mark = Amplitude::parseDottedMeters(m);
 
-        const Station& s = m_Parent->station(key);
-        TideEvent::Organizer org;
-        while (org.size() < m_Size) {
-            Timestamp then = start + Interval::fromSeconds(3600*24);
-            s.predictTideEvents(start, then, org, mark);
-            start = then;
-        }
-
-        QMapIterator<Timestamp, TideEvent> ev(org);
-        int cnt = m_Size;
-        while (ev.hasNext() && cnt > 0) {
-            ev.next();
-            cnt--;
-            m_Events.push_back(ev.value());
+        const Station& s = m_Parent->station(StationHandle::fromKey(key));
+        if (!s.isvalid()) {
+            // still loading, show the events of the last run
+            m_Events = m_Stations->snapshotEvents(key).mid(0, m_Size);
+        } else {
+            TideEvent::Organizer org;
+            while (org.size() < m_Size) {
+                Timestamp then = start + Interval::fromSeconds(3600*24);
+                s.predictTideEvents(start, then, org, mark);
+                start = then;
+            }
+
+            QMapIterator<Timestamp, TideEvent> ev(org);
+            int cnt = m_Size;
+            while (ev.hasNext() && cnt > 0) {
+                ev.next();
+                cnt--;
+                m_Events.push_back(ev.value());
+            }
         }
 
 
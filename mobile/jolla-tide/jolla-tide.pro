@@ -2,7 +2,7 @@ TEMPLATE = app
 
 TARGET = jolla-tide
 CONFIG += c++11 sailfishapp
-QT += qml quick sql xml dbus
+QT += qml quick sql xml dbus concurrent
 
 
 TOP = $${_PRO_FILE_PWD_}/../..
@@ -36,25 +36,27 @@ INSTALLS += ai
 
 SOURCES += $${TSRC}/Angle.cpp $${TSRC}/Amplitude.cpp $${TSRC}/Coordinates.cpp \
     $${TSRC}/Interval.cpp $${TSRC}/Timestamp.cpp $${TSRC}/Speed.cpp $${TSRC}/Year.cpp \
-    $${TSRC}/RunningSet.cpp $${TSRC}/Complex.cpp $${TSRC}/HarmonicsCreator.cpp \
-    $${TSRC}/Database.cpp $${TSRC}/Address.cpp $${TSRC}/PatchIterator.cpp \
-    $${TSRC}/Station.cpp $${TSRC}/Skycal.cpp $${TSRC}/StationProvider.cpp $${TSRC}/TideEvent.cpp $${TSRC}/ActiveStations.cpp \
+    $${TSRC}/RunningSet.cpp $${TSRC}/Complex.cpp $${TSRC}/HarmonicsCreator.cpp $${TSRC}/ModeRegistry.cpp \
+    $${TSRC}/Database.cpp $${TSRC}/Address.cpp $${TSRC}/PatchIterator.cpp $${TSRC}/Readings.cpp $${TSRC}/SampleCache.cpp $${TSRC}/StationInfo.cpp $${TSRC}/StationHandle.cpp $${TSRC}/Plugins.cpp \
+    $${TSRC}/Station.cpp $${TSRC}/Skycal.cpp $${TSRC}/StationProvider.cpp $${TSRC}/StationIndex.cpp $${TSRC}/StationGrid.cpp $${TSRC}/Snapshot.cpp $${TSRC}/TideEvent.cpp $${TSRC}/ActiveStations.cpp \
     $${TSRC}/Events.cpp $${TSRC}/WebFactory.cpp $${TSRC}/TideForecast.cpp $${TSRC}/Factories.cpp \
     CoverModel.cpp main.cpp
 
 
 HEADERS += $${TSRC}/Amplitude.h $${TSRC}/ConstituentSet.h $${TSRC}/Speed.h $${TSRC}/Year.h \
     $${TSRC}/Angle.h $${TSRC}/Coordinates.h $${TSRC}/Interval.h $${TSRC}/Timestamp.h \
-    $${TSRC}/RunningSet.h $${TSRC}/HarmonicsCreator.h $${TSRC}/Complex.h \
-    $${TSRC}/Database.h $${TSRC}/Address.h $${TSRC}/PatchIterator.h \
-    $${TSRC}/Station.h $${TSRC}/Skycal.h $${TSRC}/StationProvider.h $${TSRC}/TideEvent.h $${TSRC}/StationFactory.h \
+    $${TSRC}/RunningSet.h $${TSRC}/HarmonicsCreator.h $${TSRC}/ModeRegistry.h $${TSRC}/Complex.h \
+    $${TSRC}/Database.h $${TSRC}/Address.h $${TSRC}/PatchIterator.h $${TSRC}/Readings.h $${TSRC}/SampleCache.h $${TSRC}/StationInfo.h $${TSRC}/StationHandle.h $${TSRC}/Plugins.h \
+    $${TSRC}/Station.h $${TSRC}/Skycal.h $${TSRC}/StationProvider.h $${TSRC}/StationIndex.h $${TSRC}/StationGrid.h $${TSRC}/Snapshot.h $${TSRC}/TideEvent.h $${TSRC}/StationFactory.h \
     $${TSRC}/ActiveStations.h $${TSRC}/Events.h $${TSRC}/WebFactory.h $${TSRC}/TideForecast.h $${TSRC}/Factories.h \
     CoverModel.h
 
 
 DEFINES += QT_STATICPLUGIN NO_POINTSWINDOW
 
-RESOURCES += $${TOP}/harmonics.qrc $${TOP}/icons.qrc
+include($${FILES}/congen.pri)
+
+RESOURCES += $${TOP}/icons.qrc
 
 LIBS += -lxml2
 
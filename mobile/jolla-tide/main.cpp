@@ -1,7 +1,6 @@
 #include <QQmlApplicationEngine>
 #include <QtPlugin>
 #include <QGuiApplication>
-#include <QPluginLoader>
 #include <QQmlContext>
 #include <QtQml>
 #include <QDebug>
@@ -10,6 +9,7 @@
 #include <sailfishapp.h>
 
 #include "StationProvider.h"
+#include "Plugins.h"
 #include "TideForecast.h"
 #include "ActiveStations.h"
 #include "Events.h"
@@ -41,29 +41,12 @@ int main(int argc, char *argv[])
     }
 
 
-    QList<Tide::StationFactory*> factories;
-    foreach (QObject* plugin, QPluginLoader::staticInstances()) {
-        Tide::StationFactory* factory = qobject_cast<Tide::StationFactory*>(plugin);
-        if (factory) {
-            factories.append(factory);
-        }
-    }
-
-    QDir pluginsDir(qApp->applicationDirPath());
-    pluginsDir.cd("plugins");
-
-    foreach (QString fileName, pluginsDir.entryList(QDir::Files)) {
-        QPluginLoader loader(pluginsDir.absoluteFilePath(fileName));
-        Tide::StationFactory* factory = qobject_cast<Tide::StationFactory*>(loader.instance());
-        if (factory) {
-            factories.append(factory);
-        }
-    }
+    Tide::Plugins plugins(QDir(qApp->applicationDirPath()).filePath("plugins"));
 
     QScopedPointer<QQuickView> view(SailfishApp::createView());
 
 
-    Tide::Factories factoryModel(factories);
+    Tide::Factories factoryModel(&plugins);
     view->rootContext()->setContextProperty("factoryModel", &factoryModel);
 
     Tide::StationProvider stations(&factoryModel);
@@ -45,8 +45,14 @@ Page {
                 width: parent.width
             }
 
+            BusyIndicator {
+                anchors.centerIn: parent
+                size: BusyIndicatorSize.Large
+                running: stationModel.loading
+            }
+
             ViewPlaceholder {
-                enabled: locationListView.count == 0
+                enabled: locationListView.count == 0 && !stationModel.loading
                 //% "No matching stations"
                 text: qsTrId("tide-no-matching-stations")
                 //% "Search and select new location"
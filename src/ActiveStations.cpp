@@ -3,6 +3,7 @@
 #include "Database.h"
 #include <QDebug>
 #include <QDateTime>
+#include <QCoreApplication>
 
 #ifndef NO_POINTSWINDOW
 #include "PointsWindow.h"
@@ -13,11 +14,21 @@ Tide::ActiveStations::~ActiveStations() {}
 
 Tide::ActiveStations::ActiveStations(StationProvider* parent):
     QAbstractListModel(parent),
-    m_Parent(parent)
+    m_Parent(parent),
+    m_Save(new QTimer(this))
 {
+    foreach (const Snapshot::Row& row, Snapshot::Load()) {
+        m_Snapshot[StationHandle::fromKey(row.key)] = row;
+    }
+    m_Save->setSingleShot(true);
+    m_Save->setInterval(5000);
+    connect(m_Save, SIGNAL(timeout()), this, SLOT(saveSnapshot()));
+    // saved while the provider and the factories are still alive
+    connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(saveSnapshot()));
+
     Database::ActiveList acs = Database::ActiveStations();
     foreach (Database::Active ac, acs) {
-        QString key = ac.address.key();
+        StationHandle key = StationHandle::intern(ac.address);
         m_Marks[key] = Amplitude::parseDottedMeters(ac.mark);
         m_Stations.append(key);
         Data d;
@@ -26,8 +37,9 @@ Tide::ActiveStations::ActiveStations(StationProvider* parent):
         connect(d.recompute, SIGNAL(timeout()), this, SLOT(computeNextEvent()));
         m_Events[key] = d;
     }
+    m_Parent->pin(m_Stations);
     computeNextEvent();
-    connect(m_Parent, SIGNAL(stationChanged(const QString&)), this, SLOT(stationChanged(const QString&)));
+    connect(m_Parent, SIGNAL(stationChanged(const Tide::StationHandle&)), this, SLOT(stationChanged(const Tide::StationHandle&)));
     connect(m_Parent, SIGNAL(stationReset()), this, SLOT(computeNextEvent()));
 }
 
@@ -44,19 +56,21 @@ QVariant Tide::ActiveStations::data(const QModelIndex& index, int role) const {
         return QVariant();
     }
 
-    QString key = m_Stations[index.row()];
+    StationHandle key = m_Stations[index.row()];
 
 
     if (role == KeyRole) {
-        return key;
+        return key.key();
     }
 
     if (role == NameRole) {
-        return m_Parent->info(key).attribute("name");
+        if (m_Snapshot.contains(key)) return m_Snapshot[key].name;
+        return m_Parent->record(key).name;
     }
 
     if (role == LevelRole) {
         const Station& s = m_Parent->station(key);
+        if (!s.isvalid() && m_Snapshot.contains(key)) return m_Snapshot[key].level;
         return s.predictTideLevel(Timestamp::now()).print();
     }
 
@@ -66,6 +80,10 @@ QVariant Tide::ActiveStations::data(const QModelIndex& index, int role) const {
 
 
     TideEvent ev = m_Events[key].next;
+    if (ev.type == TideEvent::invalid) {
+        QList<TideEvent> evs = snapshotEvents(key.key());
+        if (!evs.isEmpty()) ev = evs.first();
+    }
     if (role == NextEventDescRole) {
         return ev.description();
     }
@@ -93,11 +111,13 @@ QHash<int, QByteArray> Tide::ActiveStations::roleNames() const {
 }
 
 
-void Tide::ActiveStations::append(const QString& station) {
+void Tide::ActiveStations::append(const QString& key) {
+    StationHandle station = StationHandle::fromKey(key);
     int row = m_Stations.size();
     beginInsertRows(QModelIndex(), row, row);
     m_Stations.append(station);
-    Database::OrderActives(Address::fromKeys(m_Stations));
+    Database::OrderActives(m_Stations);
+    m_Parent->pin(m_Stations);
     Data d;
     d.recompute = new QTimer(this);
     d.recompute->setSingleShot(true);
@@ -110,7 +130,7 @@ void Tide::ActiveStations::append(const QString& station) {
 }
 
 void Tide::ActiveStations::computeNextEvent(bool reset) {
-    QHashIterator<QString, Data> ev(m_Events);
+    QHashIterator<StationHandle, Data> ev(m_Events);
     while (ev.hasNext()) {
         ev.next();
         QTimer* r = ev.value().recompute;
@@ -133,9 +153,10 @@ void Tide::ActiveStations::computeNextEvent(bool reset) {
         QModelIndex c = index(m_Stations.indexOf(ev.key()));
         emit dataChanged(c, c);
     }
+    m_Save->start();
 }
 
-void Tide::ActiveStations::stationChanged(const QString& key) {
+void Tide::ActiveStations::stationChanged(const Tide::StationHandle& key) {
     if (!m_Events.contains(key)) return;
 
     QTimer* r = m_Events[key].recompute;
@@ -154,6 +175,50 @@ void Tide::ActiveStations::stationChanged(const QString& key) {
     r->start(tmout.seconds * 1000);
     QModelIndex c = index(m_Stations.indexOf(key));
     emit dataChanged(c, c);
+    m_Save->start();
+}
+
+QList<Tide::TideEvent> Tide::ActiveStations::snapshotEvents(const QString& key) const {
+    QList<TideEvent> evs;
+    StationHandle station = StationHandle::fromKey(key);
+    if (!m_Snapshot.contains(station)) return evs;
+    Timestamp now = Timestamp::now();
+    foreach (const TideEvent& ev, m_Snapshot[station].events) {
+        if (ev.time > now) evs.append(ev);
+    }
+    return evs;
+}
+
+// Loaded stations are predicted afresh, the others keep their last row
+void Tide::ActiveStations::saveSnapshot() {
+    Snapshot::Rows rows;
+    Timestamp now = Timestamp::now();
+    foreach (StationHandle key, m_Stations) {
+        if (!m_Parent->ready(key)) {
+            if (m_Snapshot.contains(key)) rows.append(m_Snapshot[key]);
+            continue;
+        }
+        const Station& s = m_Parent->station(key);
+        Snapshot::Row row;
+        row.key = key.key();
+        row.name = m_Parent->record(key).name;
+        row.level = s.predictTideLevel(now).print();
+        TideEvent::Organizer org;
+        Timestamp start = now;
+        while (org.size() < Snapshot::EventCount) {
+            Timestamp then = start + Interval::fromSeconds(3600*24);
+            s.predictTideEvents(start, then, org, m_Marks[key]);
+            start = then;
+        }
+        QMapIterator<Timestamp, TideEvent> ev(org);
+        while (ev.hasNext() && row.events.size() < Snapshot::EventCount) {
+            ev.next();
+            row.events.append(ev.value());
+        }
+        m_Snapshot[key] = row;
+        rows.append(row);
+    }
+    Snapshot::Save(rows);
 }
 
 
@@ -161,7 +226,7 @@ bool Tide::ActiveStations::removeRows(int row, int count, const QModelIndex& par
     if (count != 1) return false;
     if (row < 0 || row > m_Stations.size() - 1) return false;
     beginRemoveRows(parent, row, row);
-    QString station = m_Stations[row];
+    StationHandle station = m_Stations[row];
     m_Stations.removeAt(row);
     delete m_Events[station].recompute;
     m_Events.remove(station);
@@ -172,13 +237,17 @@ bool Tide::ActiveStations::removeRows(int row, int count, const QModelIndex& par
 
 void Tide::ActiveStations::remove(int row) {
     removeRows(row, 1);
-    emit dataChanged(index(0), index(m_Stations.size() - 1));
-    Database::OrderActives(Address::fromKeys(m_Stations));
+    m_Save->start();
+    if (!m_Stations.isEmpty()) {
+        emit dataChanged(index(0), index(m_Stations.size() - 1));
+    }
+    Database::OrderActives(m_Stations);
+    m_Parent->pin(m_Stations);
 }
 
 void Tide::ActiveStations::movetotop(int row) {
     if (row < 1 || row > m_Stations.size() - 1) return;
-    QString station = m_Stations[row];
+    StationHandle station = m_Stations[row];
     Amplitude mark = m_Marks.value(station);
     removeRows(row, 1);
     beginInsertRows(QModelIndex(), 0, 0);
@@ -192,23 +261,24 @@ void Tide::ActiveStations::movetotop(int row) {
     computeNextEvent();
     endInsertRows();
     emit dataChanged(index(0), index(m_Stations.size() - 1));
-    Database::OrderActives(Address::fromKeys(m_Stations));
+    Database::OrderActives(m_Stations);
+    m_Parent->pin(m_Stations);
 }
 
 
 #ifndef NO_POINTSWINDOW
 void Tide::ActiveStations::showpoints(int row) {
-    QString key = m_Stations[row];
+    StationHandle key = m_Stations[row];
     const Station& s = m_Parent->station(key);
-    PointsWindow* w = new PointsWindow(Address::fromKey(key), s);
+    PointsWindow* w = new PointsWindow(key.address(), s);
     w->resize(1600, 800);
     w->show();
 }
 #endif
 
 void Tide::ActiveStations::setmark(int row, const QString& mark) {
-    QString key = m_Stations[row];
+    StationHandle key = m_Stations[row];
     m_Marks[key] = Amplitude::parseDottedMeters(mark);
-    Database::SetMark(Address::fromKey(key), m_Marks[key].print());
+    Database::SetMark(key, m_Marks[key].print());
     stationChanged(key);
 }
@@ -2,10 +2,11 @@
 #define ACTIVE_STATIONS_H
 
 #include <QAbstractListModel>
-#include <QtXml/QDomDocument>
 #include <QTimer>
 
 #include "TideEvent.h"
+#include "StationHandle.h"
+#include "Snapshot.h"
 
 namespace Tide {
 
@@ -44,7 +45,7 @@ public:
 
     bool removeRows(int row, int count, const QModelIndex& parent = QModelIndex()) Q_DECL_OVERRIDE;
 
-    Q_INVOKABLE void append(const QString& station);
+    Q_INVOKABLE void append(const QString& key);
     Q_INVOKABLE void remove(int row);
     Q_INVOKABLE void movetotop(int row);
     Q_INVOKABLE void setmark(int row, const QString& mark);
@@ -53,6 +54,9 @@ public:
     Q_INVOKABLE void showpoints(int row);
 #endif
 
+    // upcoming events of the last run, for stations still loading
+    QList<TideEvent> snapshotEvents(const QString& key) const;
+
     ~ActiveStations();
 
 public slots:
@@ -61,7 +65,8 @@ public slots:
 
 private slots:
 
-    void stationChanged(const QString&);
+    void stationChanged(const Tide::StationHandle&);
+    void saveSnapshot();
 
 private:
 
@@ -71,10 +76,12 @@ private:
         QTimer* recompute;
     };
 
-    QList<QString> m_Stations;
-    QHash<QString, Data> m_Events;
-    QHash<QString, Amplitude> m_Marks;
+    StationHandle::HandleList m_Stations;
+    QHash<StationHandle, Data> m_Events;
+    QHash<StationHandle, Amplitude> m_Marks;
     StationProvider* m_Parent;
+    QHash<StationHandle, Snapshot::Row> m_Snapshot;
+    QTimer* m_Save;
 };
 
 }
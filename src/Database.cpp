@@ -4,15 +4,27 @@
 #include <QVariant>
 #include <QSqlError>
 #include <QDebug>
-#include <QtXml/QDomDocument>
+#include <QMutex>
+#include <QThread>
+#include <QThreadStorage>
+#include <QStringList>
 
 #include "Database.h"
+#include "Readings.h"
+#include "SampleCache.h"
 
 using namespace Tide;
 
+static QMutex schemaLock;
+static bool schemaReady = false;
+
+// One connection per thread, opened on first use in that thread and kept
+// open. In WAL mode readers are not blocked by the writer, so the
+// application, the updater and background fits can share tides.db.
 Database::Database() {
 
-    m_DB = QSqlDatabase::addDatabase("QSQLITE");
+    QString name = QString("tides-%1").arg(quintptr(QThread::currentThreadId()));
+    m_DB = QSqlDatabase::addDatabase("QSQLITE", name);
     // ~/.local/share
     QString loc = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
     loc = QString("%1/jolla-tide").arg(loc);
@@ -21,28 +33,256 @@ Database::Database() {
     }
     QString dbfile = QString("%1/tides.db").arg(loc);
     m_DB.setDatabaseName(dbfile);
-    m_DB.open();
-    QSqlQuery query;
-    query.exec("create table if not exists stations ("
-               "id integer primary key autoincrement, "
-               "fuid text not null, "
-               "suid text not null, "
-               "xmlinfo text not null)");
-    query.exec("create table if not exists actives ("
-               "id integer primary key autoincrement, "
-               "station_id integer not null, "
-               "mark text default 'notset', "
-               "ordering integer)");
+    m_DB.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+    open();
+}
+
+Database::~Database() {
+    QString name = m_DB.connectionName();
+    m_Statements.clear();
+    m_Query = QSqlQuery();
     m_DB.close();
+    m_DB = QSqlDatabase();
+    QSqlDatabase::removeDatabase(name);
 }
 
 Database* Database::instance() {
-    static Database* db = new Database();
-    return db;
+    static QThreadStorage<Database*> db;
+    if (!db.hasLocalData()) {
+        db.setLocalData(new Database());
+        db.localData()->migrate();
+    }
+    return db.localData();
+}
+
+// Schema migrations, applied in order. Each runs once, in its own
+// transaction, and bumps schema_version. A migration that fails is rolled
+// back and the process stops, it does not run on a partial schema. Only
+// ever append to this list.
+
+static bool run(const QStringList& statements) {
+    foreach (QString sql, statements) {
+        if (!Database::Control(sql)) return false;
+    }
+    return true;
+}
+
+// The tables as they were created before versioning; no-op on old databases
+static bool createTables() {
+    QStringList statements;
+    statements << "create table if not exists stations ("
+                  "id integer primary key autoincrement, "
+                  "fuid text not null, "
+                  "suid text not null, "
+                  "xmlinfo text not null)";
+    statements << "create table if not exists actives ("
+                  "id integer primary key autoincrement, "
+                  "station_id integer not null, "
+                  "mark text default 'notset', "
+                  "ordering integer)";
+    statements << "create table if not exists extents ("
+                  "station_id integer primary key, "
+                  "first      integer not null, "
+                  "last       integer not null, "
+                  "step       integer not null, "
+                  "epochs     integer not null, "
+                  "fit        integer not null default 0)";
+    statements << "create table if not exists epochs ("
+                  "id         integer primary key, "
+                  "station_id integer not null, "
+                  "start      integer not null, "
+                  "timedelta  integer not null, "
+                  "patchsize  integer not null)";
+    statements << "create table if not exists epoch_readings ("
+                  "epoch_id integer primary key, "
+                  "count    integer not null, "
+                  "data     blob not null)";
+    statements << "create table if not exists locations ("
+                  "id         integer primary key, "
+                  "station_id integer not null, "
+                  "location   text not null)";
+    statements << "create table if not exists constituents ("
+                  "id       integer primary key, "
+                  "epoch_id integer not null, "
+                  "mode_id  integer not null, "
+                  "rea real not null, "
+                  "ima real not null)";
+    statements << "create table if not exists modes ("
+                  "id    integer primary key, "
+                  "name  text not null, "
+                  "omega real not null)";
+    statements << "create table if not exists modes_version ("
+                  "version text not null)";
+    // inputs of the fit that produced the constituents of an epoch
+    statements << "create table if not exists fits ("
+                  "epoch_id    integer primary key, "
+                  "fingerprint text not null, "
+                  "stale       integer not null default 0)";
+    return run(statements);
+}
+
+static bool packReadings() {
+    return Readings::PackLegacy();
+}
+
+static const char* fillExtents =
+        "insert or ignore into extents (station_id, first, last, step, epochs) "
+        "select station_id, min(start), max(start + timedelta * (patchsize - 1)), "
+        "max(timedelta), count(*) from epochs group by station_id";
+
+// extents of data stored before they were maintained
+static bool backfillExtents() {
+    return Database::Control(fillExtents);
+}
+
+// Unique constraints on the natural keys, after dropping duplicates that
+// the code never looked past, and indexes for the hot lookups. The rows
+// of a dropped station move to the one kept, the rows of a dropped epoch
+// go with it.
+static bool createIndexes() {
+    // the sample caches of the dropped stations go too, those of the kept
+    // ones no longer match their merged epochs
+    QList<QVector<QVariant>> dropped = Database::Query("select id from stations where id not in "
+                                                       "(select min(id) from stations group by fuid, suid)");
+    foreach (QVector<QVariant> row, dropped) {
+        SampleCache::Remove(row[0].toLongLong());
+    }
+
+    QStringList statements;
+    statements << "create temp table station_dups as "
+                  "select s.id as old_id, k.id as new_id from stations s join "
+                  "(select min(id) as id, fuid, suid from stations group by fuid, suid) k "
+                  "on s.fuid=k.fuid and s.suid=k.suid where s.id != k.id";
+    foreach (QString table, QStringList() << "actives" << "epochs" << "locations") {
+        statements << QString("update %1 set station_id=(select new_id from station_dups where old_id=station_id) "
+                              "where station_id in (select old_id from station_dups)").arg(table);
+    }
+    // refilled below from the merged epochs
+    statements << "delete from extents where station_id in "
+                  "(select old_id from station_dups union select new_id from station_dups)";
+    statements << "drop table station_dups";
+    statements << "delete from stations where id not in (select min(id) from stations group by fuid, suid)";
+    statements << "create unique index if not exists stations_address on stations (fuid, suid)";
+
+    statements << "delete from actives where id not in (select min(id) from actives group by station_id)";
+    statements << "delete from actives where station_id not in (select id from stations)";
+    statements << "delete from epochs where station_id not in (select id from stations)";
+
+    statements << "delete from epochs where id not in (select min(id) from epochs group by station_id, start)";
+    statements << "create unique index if not exists epochs_station_start on epochs (station_id, start)";
+    // covers the epoch scan of PatchIterator
+    statements << "create index if not exists epochs_station_patch on epochs "
+                  "(station_id, start, id, timedelta, patchsize)";
+    statements << "delete from epoch_readings where epoch_id not in (select id from epochs)";
+    statements << "delete from constituents where epoch_id not in (select id from epochs)";
+    statements << "delete from fits where epoch_id not in (select id from epochs)";
+    statements << fillExtents;
+
+    statements << "delete from constituents where id not in "
+                  "(select max(id) from constituents group by epoch_id, mode_id)";
+    statements << "create unique index if not exists constituents_epoch_mode on constituents (epoch_id, mode_id)";
+
+    statements << "delete from modes where id not in (select min(id) from modes group by name)";
+    statements << "create unique index if not exists modes_name on modes (name)";
+
+    statements << "delete from locations where station_id not in (select id from stations)";
+    statements << "delete from locations where id not in (select max(id) from locations group by station_id)";
+    statements << "create unique index if not exists locations_station on locations (station_id)";
+
+    statements << "create index if not exists actives_station on actives (station_id)";
+    return run(statements);
+}
+
+// Station attributes in columns, parsed once from the xml they were
+// stored as
+static bool stationColumns() {
+    QStringList columns;
+    columns << "name" << "type" << "country" << "county" << "region" << "location";
+    foreach (QString column, columns) {
+        if (!Database::Control(QString("alter table stations add column %1 text not null default ''").arg(column))) {
+            return false;
+        }
+    }
+
+    QList<QVector<QVariant>> r = Database::Query("select id, suid, xmlinfo from stations");
+    QList<QVariantList> values;
+    for (int k = 0; k < columns.size() + 1; k++) values.append(QVariantList());
+    foreach (QVector<QVariant> row, r) {
+        StationInfo info = StationInfo::fromXml(row[1].toString(), row[2].toString());
+        values[0] << info.name;
+        values[1] << info.type;
+        values[2] << info.country;
+        values[3] << info.county;
+        values[4] << info.region;
+        values[5] << info.location;
+        values[6] << row[0];
+    }
+    if (r.isEmpty()) return true;
+    return Database::Batch("update stations set name=?, type=?, country=?, county=?, region=?, location=?, xmlinfo='' "
+                           "where id=?", values);
+}
+
+static bool (*const migrations[])() = {
+    createTables,
+    packReadings,
+    backfillExtents,
+    createIndexes,
+    stationColumns,
+};
+
+void Database::migrate() {
+    QMutexLocker lock(&schemaLock);
+    if (schemaReady) return;
+
+    Control("create table if not exists schema_version (version integer not null)");
+    int count = sizeof(migrations) / sizeof(migrations[0]);
+    for (int version = 1; version <= count; version++) {
+        // immediate: another process may be migrating the same file. Its
+        // migration may outlast the busy timeout, keep waiting for it: the
+        // connection is not usable before the schema is current.
+        QSqlError error;
+        while ((error = exec("begin immediate").lastError()).isValid()) {
+            if (error.nativeErrorCode() != "5") { // SQLITE_BUSY
+                qFatal("schema migration %d: %s", version, qPrintable(error.text()));
+            }
+            qDebug() << "schema migration" << version << "waiting, database busy";
+            QThread::msleep(100);
+        }
+        QList<QVector<QVariant>> r = Query("select max(version) from schema_version");
+        if (!r.isEmpty() && r.first()[0].toInt() >= version) {
+            exec("commit");
+            continue;
+        }
+        qDebug() << "applying schema migration" << version;
+        QVariantList vars;
+        vars << version;
+        if (!migrations[version - 1]() ||
+                !Control("insert into schema_version (version) values (?)", vars) ||
+                exec("commit").lastError().isValid()) {
+            exec("rollback");
+            qFatal("schema migration %d failed, rolled back", version);
+        }
+    }
+    schemaReady = true;
+}
+
+void Database::open() {
+    if (m_DB.isOpen()) return;
+    if (!m_DB.open()) {
+        qDebug() << m_DB.lastError();
+        return;
+    }
+    QSqlQuery pragma(m_DB);
+    pragma.exec("pragma journal_mode=WAL");
+    // durable at checkpoints, which is enough for downloaded data
+    pragma.exec("pragma synchronous=NORMAL");
+    pragma.exec("pragma cache_size=-8192"); // KiB
+    pragma.exec("pragma mmap_size=67108864");
+    pragma.exec("pragma temp_store=MEMORY");
 }
 
 QSqlQuery& Database::exec(const QString& sql) {
-    if (!m_DB.isOpen()) m_DB.open();
+    open();
     m_Query = QSqlQuery(m_DB);
     // qDebug() << sql;
     m_Query.exec(sql);
@@ -51,18 +291,23 @@ QSqlQuery& Database::exec(const QString& sql) {
 }
 
 
+// Statements are prepared once per connection and reused
 QSqlQuery& Database::prepare(const QString& sql) {
-    if (!m_DB.isOpen()) m_DB.open();
-    m_Query = QSqlQuery(m_DB);
-    // qDebug() << sql;
-    m_Query.prepare(sql);
-    if (m_Query.lastError().isValid()) qDebug() << m_Query.lastError();
-    return m_Query;
-}
-
-void Database::close() {
-    m_DB.commit();
-    m_DB.close();
+    open();
+    if (!m_Statements.contains(sql)) {
+        QSqlQuery q(m_DB);
+        q.setForwardOnly(true);
+        // qDebug() << sql;
+        if (!q.prepare(sql)) {
+            qDebug() << q.lastError();
+            m_Query = q;
+            return m_Query;
+        }
+        m_Statements.insert(sql, q);
+    }
+    QSqlQuery& q = m_Statements[sql];
+    q.finish();
+    return q;
 }
 
 static void exec_and_trace(QSqlQuery& r) {
@@ -84,33 +329,43 @@ Database::ActiveList Database::ActiveStations() {
     return s.values();
 }
 
-QHash<Address, QString> Database::AllStations(const QString& provider) {
-    QHash<Address, QString> s;
+static StationInfo stationInfo(const QString& suid, const QSqlQuery& r, int col) {
+    StationInfo info(suid);
+    info.name = r.value(col).toString();
+    info.type = r.value(col + 1).toString();
+    info.country = r.value(col + 2).toString();
+    info.county = r.value(col + 3).toString();
+    info.region = r.value(col + 4).toString();
+    info.location = r.value(col + 5).toString();
+    return info;
+}
+
+QHash<Address, StationInfo> Database::AllStations(const QString& provider) {
+    QHash<Address, StationInfo> s;
     QSqlQuery r;
     if (provider.isEmpty()) {
-        r = instance()->exec("select fuid, suid, xmlinfo from stations");
+        r = instance()->exec("select fuid, suid, name, type, country, county, region, location from stations");
         while (r.next()) {
             Address addr(r.value(0).toString(), r.value(1).toString());
-            s[addr] = r.value(2).toString();
+            s[addr] = stationInfo(addr.station, r, 2);
         }
     } else {
-        r = instance()->prepare("select suid, xmlinfo from stations where fuid=?");
+        r = instance()->prepare("select suid, name, type, country, county, region, location from stations where fuid=?");
         r.bindValue(0, provider);
         exec_and_trace(r);
         while (r.next()) {
             Address addr(provider, r.value(0).toString());
-            s[addr] = r.value(1).toString();
+            s[addr] = stationInfo(addr.station, r, 1);
         }
+        r.finish();
     }
-    instance()->close();
     return s;
 }
 
-void Database::OrderActives(const QList<Address>& ordering) {
-    ActiveList actives = ActiveStations();
-    QList<Address> stations;
-    foreach (Active ac, actives) {
-        stations.append(ac.address);
+void Database::OrderActives(const StationHandle::HandleList& ordering) {
+    QHash<Address, QString> marks;
+    foreach (Active ac, ActiveStations()) {
+        marks[ac.address] = ac.mark;
     }
 
     instance()->exec("delete from actives");
@@ -118,18 +373,13 @@ void Database::OrderActives(const QList<Address>& ordering) {
     Transaction();
 
     for (int ord = 0; ord < ordering.size(); ord++) {
-        QString mark("notset");
-        Address station = ordering[ord];
-        if (stations.contains(station)) mark = actives[stations.indexOf(station)].mark;
-        QSqlQuery r = instance()->prepare("select id from stations where fuid=? and suid=?");
-        r.bindValue(0, station.factory);
-        r.bindValue(1, station.station);
-        exec_and_trace(r);
-        if (!r.next()) {
+        StationHandle station = ordering[ord];
+        QString mark = marks.value(station.address(), "notset");
+        int station_id = station.stationId();
+        if (station_id == 0) {
             continue;
         }
-        int station_id = r.value(0).toInt();
-        r = instance()->prepare("insert into actives (station_id, mark, ordering) values (?, ?, ?)");
+        QSqlQuery r = instance()->prepare("insert into actives (station_id, mark, ordering) values (?, ?, ?)");
         r.bindValue(0, station_id);
         r.bindValue(1, mark);
         r.bindValue(2, ord);
@@ -139,16 +389,12 @@ void Database::OrderActives(const QList<Address>& ordering) {
     Commit();
 }
 
-void Database::SetMark(const Address& addr, const QString& mark) {
-    QSqlQuery r = instance()->prepare("select id from stations where fuid=? and suid=?");
-    r.bindValue(0, addr.factory);
-    r.bindValue(1, addr.station);
-    exec_and_trace(r);
-    if (!r.next()) {
+void Database::SetMark(const StationHandle& station, const QString& mark) {
+    int station_id = station.stationId();
+    if (station_id == 0) {
         return;
     }
-    int station_id = r.value(0).toInt();
-    r = instance()->prepare("update actives set mark=? where station_id=?");
+    QSqlQuery r = instance()->prepare("update actives set mark=? where station_id=?");
     r.bindValue(0, mark);
     r.bindValue(1, station_id);
     exec_and_trace(r);
@@ -164,53 +410,90 @@ int Database::StationID(const Address& addr) {
     if (!r.next()) {
         return 0;
     }
-    return r.value(0).toInt();
+    int station_id = r.value(0).toInt();
+    r.finish();
+    return station_id;
 }
 
-QString Database::StationInfo(const Address& addr, const QString& attr) {
+StationInfo Database::Info(const Address& addr) {
     QSqlQuery r;
-    r = instance()->prepare("select xmlinfo from stations where fuid=? and suid=?");
+    r = instance()->prepare("select name, type, country, county, region, location from stations where fuid=? and suid=?");
     r.bindValue(0, addr.factory);
     r.bindValue(1, addr.station);
     exec_and_trace(r);
     if (!r.next()) {
-        return QString();
-    }
-    QString errMsg;
-    int erow;
-    int ecol;
-    QDomDocument doc(addr.station);
-    doc.setContent(r.value(0).toString(), &errMsg, &erow, &ecol);
-    if (!errMsg.isEmpty()) {
-        qDebug() << errMsg << erow << ecol;
-        return QString();
+        return StationInfo(addr.station);
     }
-    return doc.documentElement().attribute(attr);
+    StationInfo info = stationInfo(addr.station, r, 0);
+    r.finish();
+    return info;
 }
 
-void Database::UpdateStationInfo(const Address& addr, const QString& xmlinfo) {
+void Database::UpdateStationInfo(const Address& addr, const StationInfo& info) {
     QSqlQuery r;
 
-    r = instance()->prepare("select id from stations where fuid=? and suid=?");
+    int station_id = StationID(addr);
+    if (station_id != 0) {
+        r = instance()->prepare("update stations set name=?, type=?, country=?, county=?, region=?, location=? where id=?");
+        r.bindValue(6, station_id);
+    } else {
+        // xmlinfo is a leftover of the schema before the columns
+        r = instance()->prepare("insert into stations (name, type, country, county, region, location, fuid, suid, xmlinfo) "
+                                "values (?, ?, ?, ?, ?, ?, ?, ?, '')");
+        r.bindValue(6, addr.factory);
+        r.bindValue(7, addr.station);
+    }
+    r.bindValue(0, info.name);
+    r.bindValue(1, info.type);
+    r.bindValue(2, info.country);
+    r.bindValue(3, info.county);
+    r.bindValue(4, info.region);
+    r.bindValue(5, info.location);
+    exec_and_trace(r);
+}
+
+
+Database::Extent Database::StationExtent(const Address& addr) {
+    QSqlQuery r;
+    r = instance()->prepare("select e.first, e.last, e.step, e.epochs, e.fit from extents e "
+                            "join stations s on s.id=e.station_id where s.fuid=? and s.suid=?");
     r.bindValue(0, addr.factory);
     r.bindValue(1, addr.station);
     exec_and_trace(r);
-    if (r.next()) {
-        int station_id = r.value(0).toInt();
-        r = instance()->prepare("update stations set xmlinfo=? where id=?");
-        r.bindValue(0, xmlinfo);
-        r.bindValue(1, station_id);
-    } else {
-        r = instance()->prepare("insert into stations (fuid, suid, xmlinfo) values (?, ?, ?)");
-        r.bindValue(0, addr.factory);
-        r.bindValue(1, addr.station);
-        r.bindValue(2, xmlinfo);
+    Extent e;
+    if (!r.next()) {
+        return e;
     }
+    e.first = Timestamp::fromPosixTime(r.value(0).toLongLong());
+    e.last = Timestamp::fromPosixTime(r.value(1).toLongLong());
+    e.step = Interval::fromSeconds(r.value(2).toLongLong());
+    e.epochs = r.value(3).toInt();
+    e.fit = Extent::Fit(r.value(4).toInt());
+    r.finish();
+    return e;
+}
+
+// Recompute the extent of a station from its epochs. New data makes the
+// fit stale.
+void Database::UpdateExtent(int station_id) {
+    QSqlQuery r;
+    r = instance()->prepare("insert or replace into extents (station_id, first, last, step, epochs, fit) "
+                            "select station_id, min(start), max(start + timedelta * (patchsize - 1)), "
+                            "max(timedelta), count(*), 0 from epochs where station_id=? group by station_id");
+    r.bindValue(0, station_id);
     exec_and_trace(r);
 }
 
+void Database::SetFitStatus(int station_id, Extent::Fit fit) {
+    QSqlQuery r;
+    r = instance()->prepare("update extents set fit=? where station_id=?");
+    r.bindValue(0, int(fit));
+    r.bindValue(1, station_id);
+    exec_and_trace(r);
+}
 
-void Database::Control(const QString& sql, const QVariantList& vars) {
+
+bool Database::Control(const QString& sql, const QVariantList& vars) {
     QSqlQuery r;
     if (vars.isEmpty()) {
         r = instance()->exec(sql);
@@ -221,6 +504,7 @@ void Database::Control(const QString& sql, const QVariantList& vars) {
         }
         exec_and_trace(r);
     }
+    return !r.lastError().isValid();
 }
 
 QList<QVector<QVariant>> Database::Query(const QString& sql, const QVariantList& vars) {
@@ -235,22 +519,49 @@ QList<QVector<QVariant>> Database::Query(const QString& sql, const QVariantList&
         exec_and_trace(r);
     }
     QList<QVector<QVariant>> s;
+    int cols = r.record().count();
     while (r.next()) {
-        QVector<QVariant> row(r.record().count());
-        for (int i = 0; i < r.record().count(); ++i) {
+        QVector<QVariant> row(cols);
+        for (int i = 0; i < cols; ++i) {
             // qDebug() << r.value(i);
             row[i] = r.value(i);
         }
         s << row;
     }
+    r.finish();
     return s;
 }
 
+Database::Cursor Database::Select(const QString& sql, const QVariantList& vars) {
+    QSqlQuery& r = instance()->prepare(sql);
+    for (int i = 0; i < vars.size(); ++i) {
+        r.bindValue(i, vars[i]);
+    }
+    exec_and_trace(r);
+    return Cursor(&r);
+}
+
+bool Database::Batch(const QString& sql, const QList<QVariantList>& columns) {
+    QSqlQuery& r = instance()->prepare(sql);
+    for (int i = 0; i < columns.size(); ++i) {
+        r.addBindValue(columns[i]);
+    }
+    if (!r.execBatch()) {
+        qDebug() << r.lastError();
+        return false;
+    }
+    return true;
+}
+
 bool Database::Transaction() {
-    if (!instance()->m_DB.isOpen()) instance()->m_DB.open();
+    instance()->open();
     return instance()->m_DB.transaction();
 }
 
 bool Database::Commit() {
     return instance()->m_DB.commit();
 }
+
+bool Database::Rollback() {
+    return instance()->m_DB.rollback();
+}
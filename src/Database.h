@@ -6,6 +6,9 @@
 #include <QVariantList>
 
 #include "Address.h"
+#include "Timestamp.h"
+#include "StationInfo.h"
+#include "StationHandle.h"
 
 namespace Tide {
 
@@ -24,23 +27,67 @@ public:
 
     typedef QList<Active> ActiveList;
 
+    // Streams the rows of a cached prepared statement, decoding columns on
+    // access. Nested cursors over the same SQL text are not supported.
+    class Cursor {
+    public:
+        Cursor(Cursor&& c): m_Query(c.m_Query) {c.m_Query = 0;}
+        ~Cursor() {if (m_Query) m_Query->finish();}
+        bool next() {return m_Query && m_Query->next();}
+        double toDouble(int col) const {return m_Query->value(col).toDouble();}
+        qint64 toInt(int col) const {return m_Query->value(col).toLongLong();}
+        QString toString(int col) const {return m_Query->value(col).toString();}
+        QByteArray toByteArray(int col) const {return m_Query->value(col).toByteArray();}
+    private:
+        friend class Database;
+        Cursor(QSqlQuery* q): m_Query(q) {}
+        Cursor(const Cursor&);
+        Cursor& operator=(const Cursor&);
+        QSqlQuery* m_Query;
+    };
+
+    // summary of the stored data of a station
+    class Extent {
+    public:
+        enum Fit {STALE = 0, FITTED = 1, FAILED = -1};
+        Extent(): epochs(0), fit(STALE) {}
+        bool isValid() const {return epochs > 0;}
+        Timestamp first;
+        Timestamp last;
+        Interval step;
+        int epochs;
+        Fit fit;
+    };
+
     // table actives
     static ActiveList ActiveStations();
-    static void OrderActives(const Address::AddressList& ordering);
-    static void SetMark(const Address& station, const QString& mark);
+    static void OrderActives(const StationHandle::HandleList& ordering);
+    static void SetMark(const StationHandle& station, const QString& mark);
 
     // table stations
-    static QHash<Address, QString> AllStations(const QString& provider = QString());
+    static QHash<Address, StationInfo> AllStations(const QString& provider = QString());
     static int StationID(const Address& station);
-    static QString StationInfo(const Address& station, const QString& attr);
-    static void UpdateStationInfo(const Address& provider, const QString& xmlinfo);
+    static StationInfo Info(const Address& station);
+    static void UpdateStationInfo(const Address& station, const StationInfo& info);
 
-    static void Control(const QString& sql, const QVariantList& vars = QVariantList());
+    // table extents
+    static Extent StationExtent(const Address& station);
+    static void UpdateExtent(int station_id);
+    static void SetFitStatus(int station_id, Extent::Fit fit);
+
+    // false if the statement failed
+    static bool Control(const QString& sql, const QVariantList& vars = QVariantList());
     static QList<QVector<QVariant>> Query(const QString& sql, const QVariantList& vars = QVariantList());
+    static Cursor Select(const QString& sql, const QVariantList& vars = QVariantList());
+    // one execution per row, columns holds one list of values per placeholder
+    static bool Batch(const QString& sql, const QList<QVariantList>& columns);
 
 
     static bool Transaction();
     static bool Commit();
+    static bool Rollback();
+
+    ~Database();
 
 private:
 
@@ -51,12 +98,14 @@ private:
 
     QSqlQuery& exec(const QString& query);
     QSqlQuery& prepare(const QString& query);
-    void close();
+    void open();
+    void migrate();
 
 private:
 
     QSqlDatabase m_DB;
     QSqlQuery m_Query;
+    QHash<QString, QSqlQuery> m_Statements; // prepared, by SQL text
 
 };
 
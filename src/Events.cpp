@@ -10,7 +10,9 @@ Tide::Events::~Events() {}
 Tide::Events::Events(StationProvider* parent):
     QAbstractListModel(parent),
     m_Parent(parent)
-{}
+{
+    connect(m_Parent, SIGNAL(stationChanged(const Tide::StationHandle&)), this, SLOT(stationChanged(const Tide::StationHandle&)));
+}
 
 
 
@@ -72,10 +74,20 @@ void Tide::Events::rewind() {
 
 void Tide::Events::init(const QString& key, const QString& mark) {
     qDebug() << "init" << key;
+    m_Station = StationHandle::fromKey(key);
+    m_Mark = Amplitude::parseDottedMeters(mark);
+    reload();
+}
+
+// the station was instantiated or updated
+void Tide::Events::stationChanged(const Tide::StationHandle& station) {
+    if (station != m_Station) return;
+    reload();
+}
+
+void Tide::Events::reload() {
     beginResetModel();
     m_Events.clear();
-    m_Station = key;
-    m_Mark = Amplitude::parseDottedMeters(mark);
     computeEvents(-10);
     computeEvents(10);
     qDebug() << "init" << m_Events.size();
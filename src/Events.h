@@ -5,6 +5,7 @@
 #include <QtXml/QDomDocument>
 
 #include "TideEvent.h"
+#include "StationHandle.h"
 
 namespace Tide {
 
@@ -48,6 +49,10 @@ public:
     double today() {return m_Today;}
     double delta() {return m_Delta;}
 
+private slots:
+
+    void stationChanged(const Tide::StationHandle& station);
+
 signals:
 
     void todayChanged(double v);
@@ -56,10 +61,11 @@ signals:
 private:
 
     void computeEvents(int);
+    void reload();
 
 private:
 
-    QString m_Station;
+    StationHandle m_Station;
     QList<TideEvent> m_Events;
     StationProvider* m_Parent;
     double m_Today;
@@ -22,14 +22,14 @@ ClientProxy* FactoryProxy::clone() {
 Factories::~Factories() {}
 
 
-Factories::Factories(const QList<StationFactory*>& factories, QObject* parent):
+Factories::Factories(Plugins* plugins, QObject* parent):
     QAbstractListModel(parent),
-    m_Factories(factories)
+    m_Plugins(plugins)
 {}
 
 
 int Factories::rowCount(const QModelIndex&) const {
-    return m_Factories.size();
+    return m_Plugins->size();
 }
 
 
@@ -39,25 +39,23 @@ QVariant Factories::data(const QModelIndex& index, int role) const {
         return QVariant();
     }
 
-    StationFactory* factory = m_Factories[index.row()];
-
-    QDomElement f = factory->info().info.documentElement();
+    const StationFactoryInfo& f = m_Plugins->info(index.row());
 
     if (role == NameRole || role == Qt::DecorationRole) {
-        return f.attribute("name");
+        return f.name;
     }
 
 
     if (role == AboutRole) {
-        return f.attribute("about");
+        return f.about;
     }
 
     if (role == HomePageRole) {
-        return f.attribute("home");
+        return f.home;
     }
 
     if (role == LogoRole) {
-        return f.attribute("logo");
+        return f.logo;
     }
 
     return QVariant();
@@ -72,20 +70,37 @@ QHash<int, QByteArray> Factories::roleNames() const {
     return roles;
 }
 
+const StationFactoryInfo& Factories::info(int row) const {
+    return m_Plugins->info(row);
+}
+
+int Factories::row(const QString& key) const {
+    for (int row = 0; row < m_Plugins->size(); row++) {
+        if (m_Plugins->info(row).key == key) return row;
+    }
+    return -1;
+}
+
+bool Factories::loaded(int row) const {
+    return row >= 0 && row < m_Plugins->size() && m_Plugins->loaded(row);
+}
+
 StationFactory* Factories::instance(int row) {
-    if (row < 0 || row >= m_Factories.size()) return 0;
-    return m_Factories[row];
+    if (row < 0 || row >= m_Plugins->size()) return 0;
+    bool fresh = !m_Plugins->loaded(row);
+    StationFactory* factory = m_Plugins->instance(row);
+    if (fresh && factory) {
+        emit factoryLoaded(factory->info().key);
+    }
+    return factory;
 }
 
 StationFactory* Factories::instance(const QString& key) {
-    foreach (StationFactory* f, m_Factories) {
-        if (f->info().key == key) return f;
-    }
-    return 0;
+    return instance(row(key));
 }
 
 void Factories::update(int row) {
-    if (row < 0 || row >= m_Factories.size()) return;
-    QString factory = m_Factories[row]->info().key;
-    m_Factories[row]->updateAvailable(new FactoryProxy(this, factory));
+    StationFactory* factory = instance(row);
+    if (!factory) return;
+    factory->updateAvailable(new FactoryProxy(this, factory->info().key));
 }
@@ -2,8 +2,8 @@
 #define FACTORIES_H
 
 #include <QAbstractListModel>
-#include <QtXml/QDomDocument>
 #include "StationFactory.h"
+#include "Plugins.h"
 
 
 namespace Tide {
@@ -39,8 +39,8 @@ public:
 
 public:
 
-    // create new factory info model
-    Factories(const QList<StationFactory*>& factories, QObject* parent = 0);
+    // create new factory info model, the plugins are loaded on first use
+    Factories(Plugins* plugins, QObject* parent = 0);
 
     //! Reimplemented from QAbstractItemModel
     int rowCount(const QModelIndex &parent) const Q_DECL_OVERRIDE;
@@ -52,6 +52,11 @@ public:
     QHash<int, QByteArray> roleNames() const;
 
 
+    // from the plugin metadata, without loading the plugin
+    const StationFactoryInfo& info(int row) const;
+    int row(const QString& key) const;
+    bool loaded(int row) const;
+
     StationFactory* instance(int row);
     StationFactory* instance(const QString& key);
 
@@ -64,11 +69,12 @@ public:
 signals:
 
     void availableChanged(const QString&);
+    void factoryLoaded(const QString&);
 
 
 private:
 
-    QList<StationFactory*> m_Factories;
+    Plugins* m_Plugins;
 
 };
 
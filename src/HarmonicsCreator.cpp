@@ -1,11 +1,15 @@
 #include <cmath>
+#include <algorithm>
 #include <QTextStream>
 #include <QString>
 #include <QDebug>
 #include <QVariantList>
-#include <QFile>
 #include <QMapIterator>
 #include <QStringList>
+#include <QtConcurrent>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QMutex>
 #include <Eigen/Dense>
 
 #include "Speed.h"
@@ -17,181 +21,33 @@
 
 using namespace Tide;
 
-static const double daysPerJulianCentury_double    (36525.);
-static const double hoursPerJulianCentury_double   (876600.);
-static const double secondsPerJulianCentury_double (3155760000.);
-
-static double centuries(const Timestamp& t) {
-  static const Timestamp epoch = Timestamp::fromPosixTime(-2209032000ll); // 1899-12-31 12:00 GMT
-  return (t - epoch).seconds / secondsPerJulianCentury_double;
-}
-
-class P3 {
-public:
-    P3(double t0, double t1, double t2, double t3);
-    double v(double t) const;
-    P3 d() const;
-private:
-    QVector<double> values;
-};
-
-
-P3::P3(double t0, double t1, double t2, double t3) {
-    values.append(t0);
-    values.append(t1);
-    values.append(t2);
-    values.append(t3);
-}
-
-double P3::v(double t) const {
-    double sum = 0;
-    double p = 1;
-    foreach (double x, values) {
-        sum += p * x;
-        p *= t;
-    }
-    return sum;
-}
-
-P3 P3::d() const {
-    return P3(values[1], 2 * values[2], 3 * values[3], 0);
-}
-
-class T {
-public:
-    T(const Timestamp& t);
-    double speed(const QStringList& parts) const;
-    double speed(int n1, int n2, int n3, int n4, int n5) const;
-private:
-    double v1, v2, v3, v4, v5;
-
-};
-
-T::T(const Timestamp& t) {
-    double c = centuries(t);
-    P3 m1(0, daysPerJulianCentury_double*360, 0, 0);
-    v1 = m1.d().v(c);
-    P3 m2(270 + 26./60 + 14.72/3600, 1336*360 + 1108411.2/3600, 9.09/3600, .0068/3600);
-    v2 = m2.d().v(c);
-    P3 m3(279 + 41./60 + 48.04/3600, 129602768.13/3600, 1.089/3600, 0);
-    v3 = m3.d().v(c);
-    P3 m4(334 + 19./60 + 40.87/3600, 11*360 + 392515.94/3600, -37.24/3600, -.045/3600);
-    v4 = m4.d().v(c);
-    P3 m5(281 + 13./60 + 15./3600, 6189.03/3600, 1.63/3600, .012/3600);
-    v5 = m5.d().v(c);
-}
-
-double T::speed(const QStringList& parts) const {
-    double k = 0;
-    if (parts[0] == "M1") {
-        // qDebug() << "Fixing M1";
-        k = v4 / hoursPerJulianCentury_double;
-    }
-    return speed(parts[2].toInt(), parts[3].toInt(), parts[4].toInt(), parts[5].toInt(), parts[6].toInt()) + k;
-}
-
-double T::speed(int n1, int n2, int n3, int n4, int n5) const {
-    return (v1*n1 + v2*n2 + v3*n3 + v4*n4 + v5*n5) / hoursPerJulianCentury_double;
-}
-
-class BC {
-public:
-    BC(int n1, int n2, int n3, int n4, int n5);
-    Speed speed() const;
-private:
-    int x1, x2, x3, x4, x5;
-    T t;
-};
-
-BC::BC(int n1, int n2, int n3, int n4, int n5): x1(n1), x2(n2), x3(n3), x4(n4), x5(n5), t(Timestamp::now()){}
-
-Speed BC::speed() const {
-    return Speed::fromDegreesPerHour(t.speed(x1, x2, x3, x4, x5));
-}
-
-static Speed parseConstituent(const QStringList& parts, const QList<BC>& base) {
-    static T t(Timestamp::now());
-    if (parts[1] == "Compound") {
-        Speed sum = Speed::fromRadiansPerSecond(0);
-        for (int i = 2; i < parts.size(); ++i) {
-            int mul = parts[i].toInt();
-            sum += mul * base[i-2].speed();
-        }
-        return sum;
-    }
-    return Speed::fromDegreesPerHour(t.speed(parts));
-}
-
 HarmonicsCreator::HarmonicsCreator():
     m_I(0, 1),
+    m_Modes(ModeRegistry::instance()),
     m_Data(0),
+    m_Design(0),
+    m_DesignBytes(0),
     m_AmplitudeCut(0.005), // meters
     m_SlowCut(0.2),
     m_ResolutionCut(0.9),
     m_AmplitudeDiffLowerCut(0.01),  // meters
     m_AmplitudeDiffUpperCut(1.0),  // meters
-    m_MaxSampleSize(365*6*24)
-{
-
-    Database::Control("create table if not exists constituents ("
-                      "id       integer primary key, "
-                      "epoch_id integer not null, "
-                      "mode_id  integer not null, "
-                      "rea real not null, "
-                      "ima real not null)");
-
-    Database::Control("create table if not exists modes ("
-                      "id    integer primary key, "
-                      "name  text not null, "
-                      "omega real not null)");
-
-
-    QMap<Speed, QString> modes;
-    QFile congen(":/congen_input");
-    QRegExp sep("\\s+");
-    QStringList types;
-    types << "Basic"  << "Doodson" << "Compound";
-    QList<BC> base;
-    // O1 K1 P1 M2 S2 N2 L2 K2 Q1 NU2 S1 M1-DUTCH LDA2
-
-    base << BC(1,-2,1,0,0) << BC(1,0,1,0,0) << BC(1,0,-1,0,0) << BC(2,-2,2,0,0)
-         << BC(2,0,0,0,0) << BC(2,-3,2,1,0) << BC(2,-1,2,-1,0) << BC(2,0,2,0,0)
-         << BC(1,-3,1,1,0) << BC(2,-3,4,-1,0) << BC(1,0,0,0,0) << BC(1,-1,1,1,0)
-         << BC(2,-1,0,1,0);
-
-    congen.open(QIODevice::ReadOnly|QIODevice::Text);
-    char buf[512];
-    qint64 lineLength = congen.readLine(buf, sizeof(buf));
-    while (lineLength > 0) {
-        QString line(buf);
-        lineLength = congen.readLine(buf, sizeof(buf));
-        if (line.trimmed()[0] == '#') continue;
-        QStringList parts = line.split(sep, QString::SkipEmptyParts);
-        if (parts.length() < 2) continue;
-        if (!types.contains(parts[1])) continue;
-        Speed mode = parseConstituent(parts, base);
-        if (modes.contains(mode)) {
-            // qDebug().noquote() << "skipping" << parts[0] << "~>" << modes[mode] << mode.dph();
-            continue;
-        }
-        modes[mode] = parts[0];
-    }
-
-    m_KnownModes["Z0"] = Speed::fromRadiansPerSecond(0);
-    m_KnownNames[m_KnownModes["Z0"]] = "Z0";
-    QMapIterator<Speed, QString> m(modes);
-    while (m.hasNext()) {
-        m.next();
-        // qDebug() << m.value() << m.key().dph();
-        m_KnownModes[m.value()] = m.key();
-        m_KnownNames[m.key()] = m.value();
-    }
+    m_MaxSampleSize(365*6*24),
+    m_Parallel(true),
+    m_ResidualSpectrum(false)
+{}
 
-    checkDBIntegrity();
+HarmonicsCreator::~HarmonicsCreator() {
+    delete m_Data;
+    delete m_Design;
 }
 
 HarmonicsCreator* HarmonicsCreator::instance() {
-    static HarmonicsCreator* hc = new HarmonicsCreator();
+    static HarmonicsCreator* hc = [] {
+        HarmonicsCreator* h = new HarmonicsCreator();
+        h->checkDBIntegrity();
+        return h;
+    }();
     return hc;
 }
 
@@ -244,6 +100,14 @@ void HarmonicsCreator::config(const QString& key, const QVariant& value) {
         }
         return;
     }
+    if (key.toLower() == "residualspectrum") {
+        m_ResidualSpectrum = value.toBool();
+        return;
+    }
+    if (key.toLower() == "parallel") {
+        m_Parallel = value.toBool();
+        return;
+    }
     if (key.toLower() == "maxsamplesize") {
         db_int_t v = value.toLongLong(&ok);
         if (ok) {
@@ -257,81 +121,122 @@ void HarmonicsCreator::config(const QString& key, const QVariant& value) {
 }
 
 
-void HarmonicsCreator::reset(db_int_t station_id) {
-    m_Averages.clear();
-
+// Readings of the station and the geometry of their last patch, enough
+// for fingerprint(); the mode averages are left to averageModes().
+bool HarmonicsCreator::reset(db_int_t station_id) {
     delete m_Data;
     m_Data = new PatchIterator(station_id);
+    return selectPatch(0);
+}
 
-    if (!m_Data->lastPatch()) return;
-    m_Patch = m_Data->data();
+// Geometry of the last patch of m_Data, without its last holdout readings
+bool HarmonicsCreator::selectPatch(db_int_t holdout) {
+    m_Averages.clear();
 
+    if (!m_Data->lastPatch()) return false;
+    Patch p = m_Data->data();
+    if (holdout >= p.size()) return false;
+    m_Patch = Patch(p.start(), p.step(), p.size() - holdout, p.epochs());
+    return true;
+}
 
-    Timestamp start = m_Patch.start();
-    Coefficients sums;
-    Speeds modes = m_KnownNames.keys().toVector();
-    while (m_Data->next()) {
-        double a = m_Data->reading();
-        double t = (m_Data->stamp() - start).seconds;
-        foreach (Speed q, modes) {
-            double w = q.radiansPerSecond;
-            sums[q] += a * exp(Complex(0, - w * t));
-        }
-    }
+void HarmonicsCreator::average(db_int_t holdout) {
+    if (selectPatch(holdout)) averageModes();
+}
 
+// Mode averages over m_Patch, the expensive pass over all samples
+void HarmonicsCreator::averageModes() {
+    updateResolution();
 
-    CoefficientsIterator it(sums);
-    while (it.hasNext()) {
-        it.next();
-        m_Averages[it.key()] = it.value() / m_Patch.size();
+
+    int n = m_Modes.size();
+    QVector<double> omega(n);
+    for (ModeId q = 0; q < n; q++) {
+        omega[q] = m_Modes.speed(q).radiansPerSecond;
     }
 
-}
+    const double* data = m_Data->samples().constData();
+    double step = m_Patch.step().seconds;
+    ModeVector sums(n);
+    for (db_int_t k = 0; k < m_Patch.size(); k++) {
+        double t = k * step;
+        for (ModeId q = 0; q < n; q++) {
+            sums[q] += data[k] * exp(Complex(0, - omega[q] * t));
+        }
+    }
 
+    m_Averages.resize(n);
+    for (ModeId q = 0; q < n; q++) {
+        m_Averages[q] = sums[q] / m_Patch.size();
+    }
 
-void HarmonicsCreator::average(Coefficients& coeffs, Timestamp& epoch) {
+}
 
-    if (m_Averages.isEmpty()) return;
+// Digest of everything the fit of the current patch depends on: the
+// epochs and the readings of the patch, the mode table and the cuts.
+QString HarmonicsCreator::fingerprint() {
+    QByteArray bytes;
+    QDataStream s(&bytes, QIODevice::WriteOnly);
+    s << QByteArray(ModeRegistry::TableVersion)
+      << m_AmplitudeCut << m_SlowCut << m_ResolutionCut
+      << m_AmplitudeDiffLowerCut << m_AmplitudeDiffUpperCut << m_MaxSampleSize
+      << m_Patch.start().posix() << m_Patch.step().seconds << m_Patch.size();
+    foreach (db_int_t epoch_id, m_Patch.epochs()) {
+        s << epoch_id;
+    }
 
-    coeffs = solve();
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(bytes);
+    hash.addData(reinterpret_cast<const char*>(m_Data->samples().constData()), m_Patch.size() * sizeof(double));
+    return QString::fromLatin1(hash.result().toHex());
+}
 
-    Speed z = Speed::fromRadiansPerSecond(0);
-    if (!coeffs.contains(z)) {
-        coeffs.clear();
-        return;
+// RMS of the prediction error over the readings following m_Patch
+double HarmonicsCreator::holdoutError(const Coefficients& coeffs, db_int_t& size) {
+    ModeId z = ModeRegistry::Z0;
+    double step = m_Patch.step().seconds;
+    double sum = 0;
+    Samples data = m_Data->samples();
+    size = data.size() - m_Patch.size();
+    if (size <= 0) return ::nan("");
+    for (db_int_t k = m_Patch.size(); k < data.size(); k++) {
+        double t = k * step;
+        double level = coeffs[z].x;
+        foreach (ModeId q, coeffs.modes) {
+            if (q == z) continue;
+            level += (coeffs[q] * exp(Complex(0, m_Modes.speed(q).radiansPerSecond * t))).x;
+        }
+        double e = data[k] - level;
+        sum += e * e;
     }
-
-    epoch = m_Patch.start();
+    return ::sqrt(sum / size);
 }
 
 
-HarmonicsCreator::Coefficients HarmonicsCreator::solve() {
+HarmonicsCreator::Coefficients HarmonicsCreator::refine(const Coefficients& fitted) {
 
-    Speeds modes = selectModes();
-    Coefficients coeffs;
+    Coefficients coeffs = fitted;
+    Modes modes;
     int maxLoops = 7;
     double largeAmplitudeCut = 3;
 
 
-    coeffs = fitModes(modes);
-    qDebug() << "number of modes" << modes.length();
-    qDebug() << "error estimate = " << errorEstimate(coeffs);
     bool loopit = true;
     int loopCount = 0;
     while (loopit && loopCount++ < maxLoops) {
         loopit = false;
         modes.clear();
-        Speeds filtered;
-        Speed prev = Speed::fromRadiansPerSecond(1); // just some value
-        Speed prevLarge = Speed::fromRadiansPerSecond(0);  // just some value
-        foreach (Speed q, coeffs.keys()) {
+        Modes filtered;
+        ModeId prev = ModeRegistry::Invalid; // just some value
+        ModeId prevLarge = ModeRegistry::Z0;  // just some value
+        foreach (ModeId q, coeffs.modes) {
             if (coeffs[q].mod() > largeAmplitudeCut) {
-                qDebug() << "Large mode" << m_KnownNames[q] << q.dph() << coeffs[q].mod() << coeffs[q].arg() * 180 / 3.14159;
+                qDebug() << "Large mode" << m_Modes.name(q) << m_Modes.speed(q).dph() << coeffs[q].mod() << coeffs[q].arg() * 180 / 3.14159;
                 if ((prevLarge != prev) || loopit) {
                     filtered.append(q);
                     prevLarge = q;
                 } else {
-                    qDebug() << "Skipping" << m_KnownNames[q];
+                    qDebug() << "Skipping" << m_Modes.name(q);
                     loopit = true;
                 }
             } else {
@@ -339,7 +244,7 @@ HarmonicsCreator::Coefficients HarmonicsCreator::solve() {
             }
             prev = q;
         }
-        foreach (Speed q, filtered) {
+        foreach (ModeId q, filtered) {
             if (coeffs[q].mod() < m_AmplitudeCut) {
                 loopit = true;
             } else {
@@ -349,7 +254,7 @@ HarmonicsCreator::Coefficients HarmonicsCreator::solve() {
         if (loopit) {
             coeffs = fitModes(modes);
             qDebug() << "number of modes" << modes.length();
-            qDebug() << "error estimate = " << errorEstimate(coeffs);
+            logResidual();
         }
     }
     return coeffs;
@@ -358,62 +263,222 @@ HarmonicsCreator::Coefficients HarmonicsCreator::solve() {
 typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> M_T;
 typedef Eigen::Matrix<double, Eigen::Dynamic, 1> V_T;
 
-HarmonicsCreator::Coefficients HarmonicsCreator::fitModes(Speeds& selected) {
-    Speed z = Speed::fromRadiansPerSecond(0);
-    int idx = selected.indexOf(z);
-    if (idx != -1) selected.remove(idx);
-    Coefficients coeffs;
-    coeffs[z] = m_Averages[z];
-    int rows = m_Patch.size();
-    if (rows > m_MaxSampleSize) {
-        rows = m_MaxSampleSize;
-    }
-    int firstReading = m_Patch.size() - rows;
-
-    int cols = 2 * selected.size();
-    double datum = coeffs[z].x;
-    M_T A(rows, cols);
-    V_T B(rows);
-    m_Data->lastPatch();
-    int row = 0;
-    while (m_Data->next()) {
-        if (row < firstReading) {
-            row++;
-            continue;
+// Least squares design for a sampling grid and a set of modes. All
+// stations sampled on the same grid share the design matrix, so it is
+// built and factorized only once for them.
+class Tide::HarmonicsCreator::Design {
+public:
+
+    Design(): size(0), dec(1), rows(0), first(0), center(0) {}
+
+    bool matches(const Design& d) const {
+        return !(start != d.start) && step == d.step && offset == d.offset && size == d.size &&
+                dec == d.dec && rows == d.rows && modes == d.modes;
+    }
+
+    Timestamp start;
+    Interval step;
+    Interval offset;
+    db_int_t size;
+    int dec;
+    int rows;
+    int first;
+    double center;
+    Modes modes;
+    QVector<double> omega; // radians per step
+    M_T A;
+    Eigen::FullPivHouseholderQR<M_T> qr;
+};
+
+// Number of consecutive readings averaged into one fitted sample. Long
+// records are decimated so that the design problem stays below
+// m_MaxSampleSize rows. Selected modes faster than half of the Nyquist
+// frequency of the decimated series are dropped, so the whole record is
+// always used.
+int HarmonicsCreator::decimation(Modes& selected) const {
+    db_int_t size = m_Patch.size();
+    if (size <= m_MaxSampleSize) return 1;
+
+    int d = (size + m_MaxSampleSize - 1) / m_MaxSampleSize;
+    double wmax = M_PI / (2 * d * m_Patch.step().seconds);
+    Modes kept;
+    foreach (ModeId q, selected) {
+        if (m_Modes.speed(q).radiansPerSecond > wmax) {
+            qDebug() << "decimation by" << d << "drops" << m_Modes.name(q) << m_Modes.speed(q).dph() << "deg/h";
+        } else {
+            kept.append(q);
         }
-        B(row - firstReading) = m_Data->reading() - datum;
+    }
+    selected = kept;
+    return d;
+}
+
+// Block averages of dec readings: a boxcar low pass filter followed by
+// decimation. Blocks are aligned to the end of the patch.
+HarmonicsCreator::Design HarmonicsCreator::layout(const Modes& selected) const {
+    Design d;
+    d.start = m_Patch.start();
+    d.step = m_Patch.step();
+    d.offset = m_Patch.offset();
+    d.size = m_Patch.size();
+    d.modes = selected;
+    d.dec = decimation(d.modes);
+    d.rows = d.size / d.dec;
+    d.first = d.size - d.rows * d.dec;
+    d.center = d.first + 0.5 * (d.dec - 1);
+    return d;
+}
+
+void HarmonicsCreator::factorize(const Design& key) {
+    if (m_Design && m_Design->matches(key)) {
+        qDebug() << "reusing factorized design";
+        return;
+    }
+    delete m_Design;
+    m_Design = new Design(key);
+    Design& d = *m_Design;
+
+    int cols = 2 * d.modes.size();
+    d.omega.resize(cols / 2);
+    for (int col = 0; col < cols / 2; col++) {
+        d.omega[col] = m_Modes.speed(d.modes[col]).radiansPerSecond * d.step.seconds;
+    }
+    d.A.resize(d.rows, cols);
+    for (int row = 0; row < d.rows; row++) {
         for (int col = 0; col < cols / 2; col++) {
-            double x = selected[col].radiansPerSecond * m_Patch.step().seconds * row;
-            A(row - firstReading, 2 * col) = std::cos(x);
-            A(row - firstReading, 2 * col + 1) = - std::sin(x);
+            double x = d.omega[col] * (d.center + row * d.dec);
+            d.A(row, 2 * col) = std::cos(x);
+            d.A(row, 2 * col + 1) = - std::sin(x);
         }
-        row++;
     }
-    V_T X = A.fullPivHouseholderQr().solve(B);
-    for (int col = 0; col < cols / 2; col++) {
-        Speed q = selected[col];
-        Complex coeff(X(2*col), X(2*col+1));
-        coeffs[q] = coeff;
-        qDebug() << "coeff" << m_KnownNames[q] << q.dph() << coeffs[q].mod();
+    qDebug() << "fitting" << d.rows << "samples, decimation" << d.dec;
+    d.qr.compute(d.A);
+    m_DesignBytes = qMax(m_DesignBytes, db_int_t(2 * d.A.size() * sizeof(double)));
+}
+
+void HarmonicsCreator::releaseDesign() {
+    delete m_Design;
+    m_Design = 0;
+}
+
+// Block averaged readings of the current patch, datum removed
+void HarmonicsCreator::samples(const Design& d, double* b) {
+    double datum = m_Averages[ModeRegistry::Z0].x;
+    const double* data = m_Data->samples().constData() + d.first;
+    for (int row = 0; row < d.rows; row++) {
+        double sum = 0;
+        for (int k = 0; k < d.dec; k++) {
+            sum += data[k];
+        }
+        b[row] = sum / d.dec - datum;
+        data += d.dec;
+    }
+}
+
+HarmonicsCreator::Coefficients HarmonicsCreator::coefficients(const double* x, const double* b) {
+    const Design& d = *m_Design;
+    ModeId z = ModeRegistry::Z0;
+    Coefficients coeffs(m_Modes.size());
+    coeffs.set(z, m_Averages[z]);
+
+    for (int col = 0; col < d.modes.size(); col++) {
+        ModeId q = d.modes[col];
+        // undo the gain of the boxcar filter
+        double gain = d.dec > 1 ? factor(d.omega[col], d.dec) : 1;
+        coeffs.set(q, Complex(x[2*col], x[2*col+1]) / gain);
+        qDebug() << "coeff" << m_Modes.name(q) << m_Modes.speed(q).dph() << coeffs[q].mod();
+    }
+
+    // residual statistics straight from the design matrix
+    Eigen::Map<const V_T> X(x, 2 * d.modes.size());
+    Eigen::Map<const V_T> B(b, d.rows);
+    V_T R = B - d.A * X;
+    m_Residual = Residual();
+    if (d.rows > 0) {
+        m_Residual.norm = R.norm();
+        m_Residual.rms = m_Residual.norm / ::sqrt(d.rows);
+        m_Residual.max = R.cwiseAbs().maxCoeff();
+        m_Residual.size = d.rows;
+    }
+    if (m_ResidualSpectrum && d.rows > 0) {
+        residualSpectrum(R.data(), d.rows, d.center, d.dec);
     }
 
     return coeffs;
 }
 
+HarmonicsCreator::Coefficients HarmonicsCreator::fitModes(Modes& selected) {
+    int idx = selected.indexOf(ModeRegistry::Z0);
+    if (idx != -1) selected.remove(idx);
+
+    factorize(layout(selected));
+    selected = m_Design->modes;
+    V_T B(m_Design->rows);
+    samples(*m_Design, B.data());
+    V_T X = m_Design->qr.solve(B);
+
+    return coefficients(X.data(), B.data());
+}
+
+// A station waiting to be fitted
+class Tide::HarmonicsCreator::Pending {
+public:
+    Pending(): station(0), data(0) {}
+    db_int_t station;
+    PatchIterator* data;
+    Patch patch;
+    ModeVector averages;
+    Design key;
+    Coefficients coeffs;
+    Timestamp epoch;
+    QString fingerprint;
+};
+
+// Fit a group of stations sampled on the same grid with the same initial
+// mode selection: one factorization, one multi right hand side solve.
+void HarmonicsCreator::fitGroup(QList<Pending>& group) {
+    factorize(group.first().key);
+    int rows = m_Design->rows;
+    M_T B(rows, group.size());
+    for (int i = 0; i < group.size(); i++) {
+        restore(group[i]);
+        samples(*m_Design, B.col(i).data());
+    }
+    M_T X = m_Design->qr.solve(B);
+    for (int i = 0; i < group.size(); i++) {
+        restore(group[i]);
+        group[i].coeffs = coefficients(X.col(i).data(), B.col(i).data());
+        qDebug() << "station" << group[i].station << "number of modes" << group[i].key.modes.length();
+        logResidual();
+    }
+    for (int i = 0; i < group.size(); i++) {
+        restore(group[i]);
+        group[i].coeffs = refine(group[i].coeffs);
+        if (!group[i].coeffs.contains(ModeRegistry::Z0)) {
+            group[i].coeffs.clear();
+        }
+    }
+}
+
+void HarmonicsCreator::restore(const Pending& p) {
+    m_Data = p.data;
+    m_Patch = p.patch;
+    m_Averages = p.averages;
+    updateResolution();
+}
+
 static bool Diag = true;
 
 
-HarmonicsCreator::Speeds HarmonicsCreator::selectModes() {
-    Speeds modes = m_KnownNames.keys().toVector();
-    Speed z = Speed::fromRadiansPerSecond(0);
+HarmonicsCreator::Modes HarmonicsCreator::selectModes() {
+    ModeId z = ModeRegistry::Z0;
 
-    Speeds pass_1;
+    Modes pass_1;
     pass_1.append(z);
-    foreach (Speed q, modes) {
-        if (!m_Averages.contains(q) || m_Averages[q].mod() < m_AmplitudeCut / 2 || q == z) {
-            if (m_Averages.contains(q) && q != z) {
-                qDebug() << "Skipping minor mode" << m_KnownNames[q] << q.dph() << m_Averages[q].mod();
-            }
+    for (ModeId q = 0; q < m_Modes.size(); q++) {
+        if (q == z) continue;
+        if (m_Averages[q].mod() < m_AmplitudeCut / 2) {
+            qDebug() << "Skipping minor mode" << m_Modes.name(q) << m_Modes.speed(q).dph() << m_Averages[q].mod();
             continue;
         }
         pass_1.append(q);
@@ -422,12 +487,12 @@ HarmonicsCreator::Speeds HarmonicsCreator::selectModes() {
     qDebug() << "number of modes after pass 1" << pass_1.length();
 
 
-    Speeds pass_2;
-    foreach (Speed q, pass_1) {
-        Complex elem  = computeElement(z, q, Diag);
+    Modes pass_2;
+    foreach (ModeId q, pass_1) {
+        const Complex& elem = m_Resolution(z, q);
         if (elem.mod() > m_SlowCut) {
             if (q != z) {
-                qDebug() << "Skipping long wave"  << m_KnownNames[q] << q.dph() << elem.mod();
+                qDebug() << "Skipping long wave"  << m_Modes.name(q) << m_Modes.speed(q).dph() << elem.mod();
             }
             continue;
         }
@@ -436,47 +501,39 @@ HarmonicsCreator::Speeds HarmonicsCreator::selectModes() {
 
     qDebug() << "number of modes after pass 2" << pass_2.length();
 
-    QVector<Speeds> grouping;
-    grouping.append(Speeds());
+    QVector<Modes> grouping;
+    grouping.append(Modes());
     grouping.last().append(z);
-    foreach (Speed q, pass_2) {
-        Complex elem  = computeElement(grouping.last().last(), q, Diag);
+    foreach (ModeId q, pass_2) {
+        const Complex& elem = m_Resolution(grouping.last().last(), q);
         if (elem.mod() > m_ResolutionCut) {
             grouping.last().append(q);
         } else {
-            grouping.append(Speeds());
+            grouping.append(Modes());
             grouping.last().append(q);
         }
     }
 
-    QVector<Speeds> filtered;
-    foreach (Speeds group, grouping) {
-        bool done = false;
-        Speeds modes = group;
-        while (!done && modes.length() > 1) {
-            done = checkModes(modes);
-        }
-        filtered.append(modes);
+    QVector<Modes> filtered;
+    foreach (Modes group, grouping) {
+        filtered.append(pruneModes(group));
     }
 
     qDebug() << "number of groups" << filtered.length();
 
     // Just debug logging in this loop
-    foreach (Speeds group, filtered) {
-        Speed q = group.first();
-        Speed p = group.last();
-        qDebug() << "group"  << m_KnownNames[q] << q.dph() << " -> " << m_KnownNames[p] << p.dph() << ", length" << group.length();
+    foreach (Modes group, filtered) {
+        ModeId q = group.first();
+        ModeId p = group.last();
+        qDebug() << "group"  << m_Modes.name(q) << m_Modes.speed(q).dph() << " -> " << m_Modes.name(p) << m_Modes.speed(p).dph() << ", length" << group.length();
         QString avs = "";
-        foreach (Speed w, group) {
+        foreach (ModeId w, group) {
             avs += QString("%1 ").arg(m_Averages[w].mod(), 6, 'f', 4);
             if (group.length() == 1) continue;
             QString corrs = "";
-            foreach (Speed w2, group) {
+            foreach (ModeId w2, group) {
                 if (w2 > w) {
-                    Complex r  = computeElement(w, w2, Diag);
-                    Complex dB = (m_Averages[w2] - m_Averages[w]);
-                    Complex B0 = (m_Averages[w2] + m_Averages[w]);
-                    corrs += QString("%1 ").arg((dB/B0 + r.y * m_I).mod() / (1-r.x), 6, 'g', 4);
+                    corrs += QString("%1 ").arg(correlation(w, w2), 6, 'g', 4);
                 }
             }
             if (corrs.isEmpty()) continue;
@@ -487,10 +544,10 @@ HarmonicsCreator::Speeds HarmonicsCreator::selectModes() {
 
 
 
-    Speeds selected;
+    Modes selected;
 
-    foreach (Speeds group, filtered) {
-        foreach (Speed q, group) {
+    foreach (Modes group, filtered) {
+        foreach (ModeId q, group) {
             selected.append(q);
         }
     }
@@ -499,60 +556,87 @@ HarmonicsCreator::Speeds HarmonicsCreator::selectModes() {
     return selected;
 }
 
-bool HarmonicsCreator::checkModes(Speeds& modes) {
-    Speed q = modes.first();
-    Speed p = modes.last();
-    qDebug() << "checkModes"  << m_KnownNames[q] << q.dph() << " -> " << m_KnownNames[p] << p.dph() << ", length" << modes.length();
-    foreach (Speed w, modes) {
-        foreach (Speed w2, modes) {
-            if (w2 > w) {
-                Complex r  = computeElement(w, w2, Diag);
-                Complex dB = (m_Averages[w2] - m_Averages[w]);
-                Complex B0 = (m_Averages[w2] + m_Averages[w]);
-                double corr = (dB/B0 + r.y * m_I).mod() / (1-r.x);
-                if (corr < m_AmplitudeDiffLowerCut || corr > m_AmplitudeDiffUpperCut) {
-                    if (m_Averages[w2].mod() < m_Averages[w].mod()) {
-                        qDebug() << "removing"  << m_KnownNames[w2] << w2.dph() << m_Averages[w2].mod();
-                        modes.remove(modes.indexOf(w2));
-                    } else {
-                        qDebug() << "removing"  << m_KnownNames[w] << w.dph() << m_Averages[w].mod();
-                        modes.remove(modes.indexOf(w));
-                    }
-                    return false;
-                }
+// Amplitude difference measure of two modes, w < w2
+double HarmonicsCreator::correlation(ModeId w, ModeId w2) const {
+    const Complex& r = m_Resolution(w, w2);
+    Complex dB = (m_Averages[w2] - m_Averages[w]);
+    Complex B0 = (m_Averages[w2] + m_Averages[w]);
+    return (dB/B0 + r.y * m_I).mod() / (1-r.x);
+}
+
+// Visit the modes of a group in order of decreasing average amplitude and
+// keep a mode only if it is resolvable from all the stronger modes kept so far.
+HarmonicsCreator::Modes HarmonicsCreator::pruneModes(const Modes& modes) const {
+    if (modes.length() < 2) return modes;
+
+    ModeId q = modes.first();
+    ModeId p = modes.last();
+    qDebug() << "pruneModes"  << m_Modes.name(q) << m_Modes.speed(q).dph() << " -> " << m_Modes.name(p) << m_Modes.speed(p).dph() << ", length" << modes.length();
+
+    Modes order = modes;
+    std::stable_sort(order.begin(), order.end(), [this] (ModeId a, ModeId b) {
+        return m_Averages[a].mod() > m_Averages[b].mod();
+    });
+
+    Modes kept;
+    foreach (ModeId w, order) {
+        bool resolved = true;
+        foreach (ModeId k, kept) {
+            double corr = w < k ? correlation(w, k) : correlation(k, w);
+            if (corr < m_AmplitudeDiffLowerCut || corr > m_AmplitudeDiffUpperCut) {
+                resolved = false;
+                break;
             }
         }
+        if (!resolved) {
+            qDebug() << "removing"  << m_Modes.name(w) << m_Modes.speed(w).dph() << m_Averages[w].mod();
+            continue;
+        }
+        kept.append(w);
     }
-    return true;
-}
-
-double HarmonicsCreator::errorEstimate(const Coefficients& coeffs) {
 
-    Speed z = Speed::fromRadiansPerSecond(0);
+    std::sort(kept.begin(), kept.end());
+    return kept;
+}
 
-    if (!coeffs.contains(z)) {
-        return ::nan("");
+void HarmonicsCreator::logResidual() const {
+    qDebug() << "error estimate = " << m_Residual.norm / m_Residual.size
+             << "rms" << m_Residual.rms << "max" << m_Residual.max;
+    for (ModeId q = 0; q < m_Residual.spectrum.size(); q++) {
+        if (m_Residual.spectrum[q].mod() < m_AmplitudeCut) continue;
+        qDebug() << "residual" << m_Modes.name(q) << m_Modes.speed(q).dph() << m_Residual.spectrum[q].mod();
     }
+}
 
-    Amplitude datum = Amplitude::fromDottedMeters(coeffs[z].x, 0);
-    RunningSet rset(m_Patch.start(), datum);
-
-    CoefficientsIterator m(coeffs);
-    while (m.hasNext()) {
-        m.next();
-        if (m.key() == z) continue;
-        rset.append(m.value(), m.key());
+// Project the residuals on all known modes. The phase factors are advanced
+// by complex rotation, so no trigonometric functions are evaluated per sample.
+void HarmonicsCreator::residualSpectrum(const double* r, int rows, double first, int stride) {
+    int n = m_Modes.size();
+    double step = m_Patch.step().seconds;
+    ModeVector rot(n);
+    ModeVector phase(n);
+    ModeVector sums(n);
+    for (ModeId q = 0; q < n; q++) {
+        double x = m_Modes.speed(q).radiansPerSecond * step;
+        rot[q] = exp(Complex(0, - x * stride));
+        phase[q] = exp(Complex(0, - x * first));
     }
-
-    double squareSum = 0;
-
-    m_Data->lastPatch();
-    while (m_Data->next()) {
-        double d = m_Data->reading() - (rset.datum() + rset.tideDerivative(m_Data->stamp(), 0)).value;
-        squareSum += d * d;
+    for (int row = 0; row < rows; row++) {
+        for (ModeId q = 0; q < n; q++) {
+            sums[q] += r[row] * phase[q];
+            phase[q] = phase[q] * rot[q];
+        }
+        if (row % 1024 == 1023) {
+            // keep the phase factors on the unit circle
+            for (ModeId q = 0; q < n; q++) {
+                phase[q] = phase[q] / phase[q].mod();
+            }
+        }
+    }
+    m_Residual.spectrum.resize(n);
+    for (ModeId q = 0; q < n; q++) {
+        m_Residual.spectrum[q] = sums[q] / rows;
     }
-
-    return ::sqrt(squareSum) / m_Patch.size();
 }
 
 
@@ -562,18 +646,14 @@ void HarmonicsCreator::printMatrix(const ModeMatrix& D) {
 
     QString triangle("");
 
-    ModeMatrixIterator m(D);
-    while (m.hasNext()) {
-        m.next();
+    for (ModeId q = 0; q < D.size(); q++) {
         art += triangle;
         triangle += '_';
-        ModeVectorIterator n(m.value());
-        while (n.hasNext()) {
-            n.next();
-            if (n.value().mod() < 0.01) {
+        for (ModeId p = q; p < D.size(); p++) {
+            if (D(q, p).mod() < 0.01) {
                 art += ".";
             } else {
-                unsigned v = unsigned(10*n.value().mod());
+                unsigned v = unsigned(10*D(q, p).mod());
                 art += QString("%1").arg(v, 0, 16).toUpper();
             }
         }
@@ -584,23 +664,44 @@ void HarmonicsCreator::printMatrix(const ModeMatrix& D) {
 
 
 
-Complex HarmonicsCreator::computeElement(const Speed& q, const Speed& p, bool diag) const {
+Complex HarmonicsCreator::computeElement(ModeId q, ModeId p, bool diag) const {
     double mul = diag ? -1 : 1;
-    return coeff(q.radiansPerSecond + mul * p.radiansPerSecond);
+    return coeff(m_Modes.speed(q).radiansPerSecond + mul * m_Modes.speed(p).radiansPerSecond);
 }
 
 void HarmonicsCreator::computeMatrix(ModeMatrix &m, bool diag) const {
-    double mul = diag ? -1 : 1;
-    QList<Speed> modes = m_KnownNames.keys();
-
-    foreach (Speed q, modes) {
-        foreach (Speed p, modes) {
-            if (p < q) continue;
-            m[q][p] = coeff(q.radiansPerSecond + mul * p.radiansPerSecond);
+    m = ModeMatrix(m_Modes.size());
+    QVector<ModeId> rows(m.size());
+    for (ModeId q = 0; q < m.size(); q++) {
+        rows[q] = q;
+    }
+    // element (p, q) is the conjugate of (q, p)
+    auto computeRow = [this, &m, diag] (const ModeId& q) {
+        for (ModeId p = q; p < m.size(); p++) {
+            m(q, p) = computeElement(q, p, diag);
+            m(p, q) = m(q, p).conjugate();
         }
+    };
+    if (m_Parallel) {
+        QtConcurrent::blockingMap(rows, computeRow);
+    } else {
+        std::for_each(rows.constBegin(), rows.constEnd(), computeRow);
     }
 }
 
+// The resolution matrix depends only on the patch geometry: recompute it
+// only when step, size or offset change.
+void HarmonicsCreator::updateResolution() {
+    if (m_Resolution.size() == m_Modes.size() &&
+            m_ResolutionGeometry.step() == m_Patch.step() &&
+            m_ResolutionGeometry.size() == m_Patch.size() &&
+            m_ResolutionGeometry.offset() == m_Patch.offset()) {
+        return;
+    }
+    computeMatrix(m_Resolution, Diag);
+    m_ResolutionGeometry = m_Patch;
+}
+
 Complex HarmonicsCreator::coeff(double omega) const {
     double x = m_Patch.step().seconds * omega;
     double beta = double(m_Patch.offset().seconds) / m_Patch.step().seconds + 0.5 * (m_Patch.size() - 1);
@@ -628,54 +729,80 @@ void HarmonicsCreator::checkDBIntegrity() {
     QList<QVector<QVariant>> r;
     QVariantList vars;
 
-    // Modes
-    ModeSpeedIterator m(m_KnownModes);
+    // The modes table mirrors the generated constituent table, only its
+    // version needs checking
+    QString version = QString::fromLatin1(ModeRegistry::TableVersion);
+    r = Database::Query("select version from modes_version");
+    if (!r.isEmpty() && r.first()[0].toString() == version) {
+        return;
+    }
+
+    qDebug() << "updating modes to" << version;
+
     Database::Transaction();
-    while (m.hasNext()) {
-        m.next();
+    for (ModeId q = 0; q < m_Modes.size(); q++) {
         vars.clear();
-        vars << QVariant::fromValue(m.key());
+        vars << QVariant::fromValue(m_Modes.name(q));
         r = Database::Query("select id from modes where name=?", vars);
         if (r.isEmpty()) {
             vars.clear();
-            vars << QVariant::fromValue(m.value().radiansPerSecond) << QVariant::fromValue(m.key());
+            vars << QVariant::fromValue(m_Modes.speed(q).radiansPerSecond) << QVariant::fromValue(m_Modes.name(q));
             Database::Control("insert into modes (omega, name) values (?, ?)", vars);
         } else {
             vars.clear();
-            vars << QVariant::fromValue(m.value().radiansPerSecond) << r.first()[0];
+            vars << QVariant::fromValue(m_Modes.speed(q).radiansPerSecond) << r.first()[0];
             Database::Control("update modes set omega=? where id=?", vars);
         }
     }
+    Database::Control("delete from modes_version");
+    vars.clear();
+    vars << QVariant::fromValue(version);
+    Database::Control("insert into modes_version (version) values (?)", vars);
     Database::Commit();
 }
 
-void HarmonicsCreator::select(db_int_t station_id, Coefficients& coeffs, Timestamp& epoch) {
+void HarmonicsCreator::select(db_int_t station_id, Coefficients& coeffs, Timestamp& epoch, QString& fingerprint, bool& stale) {
     QVariantList vars;
     vars << station_id;
-    QList<QVector<QVariant>> r = Database::Query("select e.id, e.start, m.omega, c.rea, c.ima from constituents c "
-                                                 "join modes m on m.id=c.mode_id join epochs e on e.id=c.epoch_id "
-                                                 "where e.station_id=?", vars);
+    Database::Cursor r = Database::Select("select e.id, e.start, m.name, c.rea, c.ima from constituents c "
+                                          "join modes m on m.id=c.mode_id join epochs e on e.id=c.epoch_id "
+                                          "where e.station_id=?", vars);
 
     // just in case there are several sets per station
     QMap<Timestamp, db_int_t> epochs;
     QMap<db_int_t, Coefficients> c;
-    foreach (QVector<QVariant> row, r) {
-        db_int_t epoch_id = row[0].toInt();
-        Timestamp start = Timestamp::fromPosixTime(row[1].toInt());
+    while (r.next()) {
+        db_int_t epoch_id = r.toInt(0);
+        Timestamp start = Timestamp::fromPosixTime(r.toInt(1));
         epochs[start] = epoch_id;
-        Speed mode = Speed::fromRadiansPerSecond(row[2].toDouble());
-        double x = row[3].toDouble();
-        double y = row[4].toDouble();
-        c[epoch_id][mode] = Complex(x, y);
+        ModeId mode = m_Modes.id(r.toString(2));
+        if (mode == ModeRegistry::Invalid) {
+            qDebug() << "unknown mode" << r.toString(2) << ", skipping";
+            continue;
+        }
+        double x = r.toDouble(3);
+        double y = r.toDouble(4);
+        if (!c.contains(epoch_id)) {
+            c[epoch_id] = Coefficients(m_Modes.size());
+        }
+        c[epoch_id].set(mode, Complex(x, y));
     }
     if (!epochs.isEmpty()) {
         db_int_t last_epoch_id = epochs.last();
         epoch = epochs.key(last_epoch_id);
         coeffs = c[last_epoch_id];
+
+        vars.clear();
+        vars << last_epoch_id;
+        Database::Cursor f = Database::Select("select fingerprint, stale from fits where epoch_id=?", vars);
+        if (f.next()) {
+            fingerprint = f.toString(0);
+            stale = f.toInt(1) != 0;
+        }
     }
 }
 
-void HarmonicsCreator::insert(db_int_t station_id, const Coefficients& coeffs, const Timestamp& epoch) {
+void HarmonicsCreator::insert(db_int_t station_id, const Coefficients& coeffs, const Timestamp& epoch, const QString& fingerprint) {
     QVariantList vars;
     vars << station_id << epoch.posix();
     QList<QVector<QVariant>> r = Database::Query("select id from epochs where station_id=? and start=?", vars);
@@ -691,70 +818,208 @@ void HarmonicsCreator::insert(db_int_t station_id, const Coefficients& coeffs, c
     r = Database::Query("select id, name from modes");
     foreach (QVector<QVariant> row, r) {
         db_int_t mode_id = row[0].toLongLong();
-        Speed q = m_KnownModes[row[1].toString()];
-        if (coeffs.contains(q)) {
+        ModeId q = m_Modes.id(row[1].toString());
+        if (q != ModeRegistry::Invalid && coeffs.contains(q)) {
             values[mode_id] = coeffs[q];
         }
     }
 
-    if (values.size() != coeffs.size()) {
+    if (values.size() != coeffs.modes.size()) {
         qDebug() << "FATAL: all modes not found, aborting insert";
         return;
     }
 
     Database::Transaction();
+    vars.clear();
+    vars << station_id;
+    Database::Control("delete from constituents where epoch_id in (select id from epochs where station_id=?)", vars);
+    Database::Control("delete from fits where epoch_id in (select id from epochs where station_id=?)", vars);
+    vars.clear();
+    vars << epoch_id << fingerprint;
+    Database::Control("insert into fits (epoch_id, fingerprint) values (?, ?)", vars);
+    Database::SetFitStatus(station_id, Database::Extent::FITTED);
+    QList<QVariantList> columns;
+    for (int i = 0; i < 4; i++) columns.append(QVariantList());
     QMapIterator<db_int_t, Complex> it(values);
     while (it.hasNext()) {
         it.next();
-        vars.clear();
-        vars << epoch_id << it.key() << it.value().x << it.value().y;
-        Database::Control("insert into constituents (epoch_id, mode_id, rea, ima) values (?, ?, ?, ?)", vars);
+        columns[0] << epoch_id;
+        columns[1] << it.key();
+        columns[2] << it.value().x;
+        columns[3] << it.value().y;
     }
+    Database::Batch("insert into constituents (epoch_id, mode_id, rea, ima) values (?, ?, ?, ?)", columns);
     Database::Commit();
 }
 
-Tide::RunningSet* HarmonicsCreator::CreateConstituents(int station_id) {
+void HarmonicsCreator::validate(db_int_t station_id) {
+    QVariantList vars;
+    vars << station_id;
+    Database::Control("update fits set stale=0 where epoch_id in (select id from epochs where station_id=?)", vars);
+    Database::SetFitStatus(station_id, Database::Extent::FITTED);
+}
 
+RunningSet* HarmonicsCreator::runningSet(const Coefficients& coeffs, const Timestamp& epoch) const {
+    ModeId z = ModeRegistry::Z0;
+    if (!coeffs.contains(z)) {
+        return 0;
+    }
 
-    Coefficients coeffs;
-    Timestamp epoch;
+    Amplitude datum = Amplitude::fromDottedMeters(coeffs[z].x, 0);
+    RunningSet* rset = new RunningSet(epoch, datum);
 
-    Speed z = Speed::fromRadiansPerSecond(0);
+    foreach (ModeId q, coeffs.modes) {
+        if (q == z) continue;
+        rset->append(coeffs[q], m_Modes.speed(q));
+    }
 
-    instance()->select(station_id, coeffs, epoch);
+    return rset;
+}
 
-    if (coeffs.isEmpty()) {
-        instance()->reset(station_id);
-        instance()->average(coeffs, epoch);
-        if (coeffs.contains(z)) {
-            instance()->insert(station_id, coeffs, epoch);
+QHash<int, RunningSet*> HarmonicsCreator::createConstituents(const QList<int>& station_ids) {
+    QHash<int, RunningSet*> sets;
+    QList<Pending> pending;
+
+    foreach (int station_id, station_ids) {
+        Pending p;
+        QString stored;
+        bool stale = false;
+        p.station = station_id;
+        select(station_id, p.coeffs, p.epoch, stored, stale);
+        if (!p.coeffs.isEmpty() && !stale) {
+            sets[station_id] = runningSet(p.coeffs, p.epoch);
+            continue;
+        }
+        if (!reset(station_id)) {
+            delete m_Data;
+            m_Data = 0;
+            Database::SetFitStatus(station_id, Database::Extent::FAILED);
+            continue;
+        }
+        // checked before the mode averages, which cost most of a fit
+        p.fingerprint = fingerprint();
+        if (!p.coeffs.isEmpty() && p.fingerprint == stored && !(p.epoch != m_Patch.start())) {
+            qDebug() << "station" << station_id << "inputs unchanged, keeping constituents";
+            delete m_Data;
+            m_Data = 0;
+            validate(station_id);
+            sets[station_id] = runningSet(p.coeffs, p.epoch);
+            continue;
         }
+        averageModes();
+        p.data = m_Data;
+        m_Data = 0;
+        p.patch = m_Patch;
+        p.averages = m_Averages;
+        p.epoch = m_Patch.start();
+        Modes modes = selectModes();
+        modes.removeAll(ModeRegistry::Z0);
+        p.key = layout(modes);
+        pending.append(p);
     }
 
-    if (!coeffs.contains(z)) {
-        return 0;
+    // Stations share a factorization only when their layouts match exactly,
+    // including the selected modes; a station whose selection differs by one
+    // mode is fitted on its own design.
+    int fitted = pending.size();
+    int groups = 0;
+    while (!pending.isEmpty()) {
+        QList<Pending> group;
+        group.append(pending.takeFirst());
+        for (int i = 0; i < pending.size();) {
+            if (pending[i].key.matches(group.first().key)) {
+                group.append(pending.takeAt(i));
+            } else {
+                i++;
+            }
+        }
+        qDebug() << "fitting" << group.size() << "stations with a shared design";
+        groups++;
+        fitGroup(group);
+        foreach (const Pending& p, group) {
+            delete p.data;
+            if (p.coeffs.contains(ModeRegistry::Z0)) {
+                insert(p.station, p.coeffs, p.epoch, p.fingerprint);
+                sets[p.station] = runningSet(p.coeffs, p.epoch);
+            } else {
+                Database::SetFitStatus(p.station, Database::Extent::FAILED);
+            }
+        }
     }
 
-    Amplitude datum = Amplitude::fromDottedMeters(coeffs[z].x, 0);
-    RunningSet* rset = new RunningSet(epoch, datum);
+    if (fitted > 0) {
+        qDebug() << "fitted" << fitted << "stations with" << groups << "designs," << fitted - groups << "factorizations reused";
+    }
+
+    m_Data = 0;
+    releaseDesign();
+
+    return sets;
+}
+
+HarmonicsCreator::Fit HarmonicsCreator::fit(PatchIterator& data, const Interval& holdout) {
+    Fit f;
+    delete m_Data;
+    m_Data = &data;
+    m_DesignBytes = 0;
 
-    CoefficientsIterator m(coeffs);
-    while (m.hasNext()) {
-        m.next();
-        if (m.key() == z) continue;
-        rset->append(m.value(), m.key());
+    db_int_t cut = 0;
+    if (data.lastPatch()) {
+        cut = holdout.seconds / data.data().step().seconds;
+    }
+    average(cut);
+
+    if (!m_Averages.isEmpty()) {
+        Modes modes = selectModes();
+        modes.removeAll(ModeRegistry::Z0);
+        Coefficients coeffs = fitModes(modes);
+        qDebug() << "number of modes" << modes.length();
+        logResidual();
+        coeffs = refine(coeffs);
+        if (coeffs.contains(ModeRegistry::Z0)) {
+            f.coeffs = coeffs;
+            f.epoch = m_Patch.start();
+            f.residual = m_Residual;
+            if (cut > 0) {
+                f.holdoutRms = holdoutError(coeffs, f.holdoutSize);
+            }
+        }
     }
 
-    return rset;
+    f.designBytes = m_DesignBytes;
+    m_Data = 0;
+    releaseDesign();
+    return f;
+}
+
+// The shared instance keeps the state of the fit in progress, callers on
+// the GUI thread and on the fitter threads of the factories take turns.
+static QMutex sharedLock;
+
+RunningSet* HarmonicsCreator::CreateConstituents(int station_id) {
+    QList<int> ids;
+    ids << station_id;
+    QMutexLocker lock(&sharedLock);
+    return instance()->createConstituents(ids).value(station_id, 0);
+}
+
+QHash<int, RunningSet*> HarmonicsCreator::CreateConstituents(const QList<int>& station_ids) {
+    QMutexLocker lock(&sharedLock);
+    return instance()->createConstituents(station_ids);
 }
 
 void HarmonicsCreator::Config(const QString& key, const QVariant& value) {
+    QMutexLocker lock(&sharedLock);
     instance()->config(key, value);
 }
 
 void HarmonicsCreator::Delete(db_int_t station_id) {
     QVariantList vars;
     vars << station_id;
-    Database::Control("delete from constituents where epoch_id in (select id from epochs where station_id=?)", vars);
+    Database::Control("update fits set stale=1 where epoch_id in (select id from epochs where station_id=?)", vars);
+    Database::SetFitStatus(station_id, Database::Extent::STALE);
+    // constituents stored without a fingerprint can only be refitted
+    Database::Control("delete from constituents where epoch_id in (select id from epochs where station_id=?) "
+                      "and epoch_id not in (select epoch_id from fits)", vars);
 }
 
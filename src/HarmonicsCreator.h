@@ -1,41 +1,101 @@
 #ifndef HARMONICS_CREATOR_H
 #define HARMONICS_CREATOR_H
 
+#include <algorithm>
 #include <QHash>
 #include <QMap>
 #include <QVector>
 #include "RunningSet.h"
 #include "PatchIterator.h"
+#include "ModeRegistry.h"
+#include "Complex.h"
 
 namespace Tide {
 
-class Complex;
-
 class HarmonicsCreator {
 public:
 
-    typedef QMap<QString, Speed> ModeSpeed;
-    typedef QMapIterator<QString, Speed> ModeSpeedIterator;
-
-    typedef QMap<Speed, QString> ModeName;
-    typedef QMapIterator<Speed, QString> ModeNameIterator;
-
-    typedef QMap<Speed, Complex> Coefficients;
-    typedef QMapIterator<Speed, Complex> CoefficientsIterator;
-
-    typedef QMap<Speed, Complex> ModeVector;
-    typedef QMapIterator<Speed, Complex> ModeVectorIterator;
-
-    typedef QMap<Speed, ModeVector> ModeMatrix;
-    typedef QMapIterator<Speed, ModeVector> ModeMatrixIterator;
+    typedef ModeRegistry::Id ModeId;
+
+    // sparse selection of modes, ascending speed
+    typedef QVector<ModeId> Modes;
+
+    // dense, indexed by mode id
+    typedef QVector<Complex> ModeVector;
+
+    // dense, row major, indexed by mode ids
+    class ModeMatrix {
+    public:
+        ModeMatrix(int n = 0): m_Size(n), m_Data(n * n) {}
+        int size() const {return m_Size;}
+        Complex& operator() (ModeId q, ModeId p) {return m_Data[q * m_Size + p];}
+        const Complex& operator() (ModeId q, ModeId p) const {return m_Data[q * m_Size + p];}
+    private:
+        int m_Size;
+        QVector<Complex> m_Data;
+    };
+
+    // dense values with a sparse view of the fitted modes
+    class Coefficients {
+    public:
+        Coefficients(int n = 0): values(n) {}
+        bool contains(ModeId q) const {return std::binary_search(modes.begin(), modes.end(), q);}
+        bool isEmpty() const {return modes.isEmpty();}
+        void clear() {modes.clear(); values.fill(Complex());}
+        const Complex& operator[] (ModeId q) const {return values[q];}
+        void set(ModeId q, const Complex& c) {
+            Modes::iterator it = std::lower_bound(modes.begin(), modes.end(), q);
+            if (it == modes.end() || *it != q) modes.insert(it, q);
+            values[q] = c;
+        }
+        ModeVector values;
+        Modes modes;
+    };
+
+    // fit residual B - A X
+    class Residual {
+    public:
+        Residual(): norm(::nan("")), rms(::nan("")), max(::nan("")), size(0) {}
+        double norm;
+        double rms;
+        double max;
+        int size;
+        ModeVector spectrum; // indexed by mode id, empty unless requested
+    };
+
+    // fit of one patch with the configuration of the creator
+    class Fit {
+    public:
+        Fit(): holdoutRms(::nan("")), holdoutSize(0), designBytes(0) {}
+        Coefficients coeffs; // empty if the fit failed
+        Timestamp epoch;
+        Residual residual;
+        double holdoutRms;
+        db_int_t holdoutSize;
+        db_int_t designBytes; // largest design matrix and its factorization
+    };
 
     typedef QVector<double> LevelData;
 
-    typedef QVector<Speed> Speeds;
+    // Instances carry their own configuration. fit() does not touch the
+    // database, so separate instances can fit in parallel once the readings
+    // of their patch iterators have been loaded.
+    HarmonicsCreator();
+    ~HarmonicsCreator();
+
+    void config(const QString& key, const QVariant& value);
+    // Fit the last patch of data, leaving out the readings of the last
+    // holdout interval and measuring the prediction error there.
+    Fit fit(PatchIterator& data, const Interval& holdout = Interval());
 
+    // The static functions share one instance and are serialized, they may
+    // be called from any thread.
     static RunningSet* CreateConstituents(int station_id);
-    static const ModeName& Modes();
+    // Stations sampled on the same grid share the least squares factorization
+    static QHash<int, RunningSet*> CreateConstituents(const QList<int>& station_ids);
     static void Config(const QString& key, const QVariant& value);
+    // Mark the constituents of a station stale. They are refitted by the
+    // next CreateConstituents only if the fitted inputs have changed.
     static void Delete(db_int_t station_id);
 
 
@@ -45,41 +105,60 @@ private:
 
     HarmonicsCreator(const HarmonicsCreator&);
     HarmonicsCreator& operator=(const HarmonicsCreator&);
-    HarmonicsCreator();
 
 
     static HarmonicsCreator* instance();
 
-    void config(const QString& key, const QVariant& value);
-
-    ModeSpeed modes() const {return m_KnownModes;}
-    ModeName names() const {return m_KnownNames;}
-
-    void reset(db_int_t station_id);
-    void average(Coefficients& coeffs, Timestamp& epoch);
-    double errorEstimate(const Coefficients& coeffs);
-    Coefficients solve();
-    Speeds selectModes();
-    bool checkModes(Speeds& modes);
+    class Design;
+    class Pending;
+
+    bool reset(db_int_t station_id);
+    bool selectPatch(db_int_t holdout);
+    void average(db_int_t holdout);
+    void averageModes();
+    QString fingerprint();
+    double holdoutError(const Coefficients& coeffs, db_int_t& size);
+    QHash<int, RunningSet*> createConstituents(const QList<int>& station_ids);
+    RunningSet* runningSet(const Coefficients& coeffs, const Timestamp& epoch) const;
+    void logResidual() const;
+    void residualSpectrum(const double* r, int rows, double first, int stride);
+    Coefficients refine(const Coefficients& fitted);
+    Modes selectModes();
+    Modes pruneModes(const Modes& modes) const;
+    double correlation(ModeId w, ModeId w2) const;
     void checkDBIntegrity();
-    void select(db_int_t station_id, Coefficients& coeffs, Timestamp& epoch);
-    void insert(db_int_t station_id, const Coefficients& coeffs, const Timestamp& epoch);
+    void select(db_int_t station_id, Coefficients& coeffs, Timestamp& epoch, QString& fingerprint, bool& stale);
+    void insert(db_int_t station_id, const Coefficients& coeffs, const Timestamp& epoch, const QString& fingerprint);
+    void validate(db_int_t station_id);
 
     void printMatrix(const ModeMatrix& m);
     void computeMatrix(ModeMatrix& m, bool diag = true) const;
-    Complex computeElement(const Speed& q, const Speed& p, bool diag) const;
+    Complex computeElement(ModeId q, ModeId p, bool diag) const;
+    void updateResolution();
     Complex coeff(double omega) const;
     double factor(double x, unsigned n) const;
-    Coefficients fitModes(Speeds& selected);
+    int decimation(Modes& selected) const;
+    Design layout(const Modes& selected) const;
+    void factorize(const Design& key);
+    void releaseDesign();
+    void samples(const Design& d, double* b);
+    Coefficients coefficients(const double* x, const double* b);
+    Coefficients fitModes(Modes& selected);
+    void fitGroup(QList<Pending>& group);
+    void restore(const Pending& p);
 
 private:
 
     Complex m_I;
-    ModeSpeed m_KnownModes;
-    ModeName m_KnownNames;
-    Coefficients m_Averages;
+    const ModeRegistry& m_Modes;
+    ModeVector m_Averages;
     Patch m_Patch;
     PatchIterator* m_Data;
+    Design* m_Design;
+    ModeMatrix m_Resolution;
+    Patch m_ResolutionGeometry;
+    Residual m_Residual;
+    db_int_t m_DesignBytes;
 
     double m_AmplitudeCut;
     double m_SlowCut;
@@ -87,6 +166,8 @@ private:
     double m_AmplitudeDiffLowerCut;
     double m_AmplitudeDiffUpperCut;
     db_int_t m_MaxSampleSize;
+    bool m_Parallel;
+    bool m_ResidualSpectrum;
 
 };
 
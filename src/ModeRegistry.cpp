@@ -0,0 +1,20 @@
+#include "ModeRegistry.h"
+
+using namespace Tide;
+
+
+ModeRegistry::ModeRegistry():
+    m_Names(TableSize),
+    m_Speeds(TableSize)
+{
+    for (Id q = 0; q < TableSize; q++) {
+        m_Names[q] = QString::fromLatin1(Table[q].name);
+        m_Speeds[q] = Speed::fromDegreesPerHour(Table[q].dph);
+        m_Ids[m_Names[q]] = q;
+    }
+}
+
+const ModeRegistry& ModeRegistry::instance() {
+    static ModeRegistry* r = new ModeRegistry();
+    return *r;
+}
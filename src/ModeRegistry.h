@@ -0,0 +1,60 @@
+#ifndef MODE_REGISTRY_H
+#define MODE_REGISTRY_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "Speed.h"
+
+namespace Tide {
+
+// Known harmonic modes (congen constituents). Each mode gets a small
+// integer id; ids are assigned in order of increasing speed and Z0
+// (zero speed) is always id 0. The constituent table is generated from
+// congen_input.txt at build time (files/congen.py).
+class ModeRegistry {
+public:
+
+    typedef int Id;
+
+    class Entry {
+    public:
+        const char* name;
+        int doodson[5]; // T s h p p1
+        double dph;
+    };
+
+    // generated
+    static const Entry Table[];
+    static const int TableSize;
+    static const char* const TableVersion;
+
+    static const Id Z0 = 0;
+    static const Id Invalid = -1;
+
+    static const ModeRegistry& instance();
+
+    int size() const {return m_Speeds.size();}
+    const QString& name(Id q) const {return m_Names[q];}
+    const Speed& speed(Id q) const {return m_Speeds[q];}
+    const int* doodson(Id q) const {return Table[q].doodson;}
+    Id id(const QString& name) const {return m_Ids.value(name, Invalid);}
+
+private:
+
+    ModeRegistry();
+    ModeRegistry(const ModeRegistry&);
+    ModeRegistry& operator=(const ModeRegistry&);
+
+private:
+
+    QVector<QString> m_Names;
+    QVector<Speed> m_Speeds;
+    QHash<QString, Id> m_Ids;
+
+};
+
+}
+
+#endif // MODE_REGISTRY_H
@@ -1,4 +1,5 @@
 #include "PatchIterator.h"
+#include "Readings.h"
 #include <QDebug>
 
 using namespace Tide;
@@ -23,6 +24,7 @@ Patch::Patch(const Patch& a):
     m_Start(a.start()),
     m_Step(a.step()),
     m_Size(a.size()),
+    m_Offset(a.offset()),
     m_Epochs(a.epochs())
 {}
 
@@ -72,12 +74,13 @@ const Patch::Epochs& Patch::epochs() const {
 }
 
 
-PatchIterator::PatchIterator(db_int_t station_id) {
+PatchIterator::PatchIterator(db_int_t station_id):
+    m_Station(station_id)
+{
 
-    QList<QVector<QVariant>> r;
     QVariantList vars;
     vars << station_id;
-    r = Database::Query("select id, start, timedelta, patchsize from epochs where station_id=? order by start", vars);
+    Database::Cursor r = Database::Select("select id, start, timedelta, patchsize from epochs where station_id=? order by start", vars);
 
 
     db_int_t patch_start = -1;
@@ -86,11 +89,11 @@ PatchIterator::PatchIterator(db_int_t station_id) {
 
     Patch::Epochs epochs;
 
-    foreach (QVector<QVariant> row, r) {
-        db_int_t epoch_id = row[0].toInt();
-        db_int_t start = row[1].toInt();
-        db_int_t step = row[2].toInt();
-        db_int_t size = row[3].toInt();
+    while (r.next()) {
+        db_int_t epoch_id = r.toInt(0);
+        db_int_t start = r.toInt(1);
+        db_int_t step = r.toInt(2);
+        db_int_t size = r.toInt(3);
 
         m_FirstStamp[epoch_id] = start;
         m_LastStamp[epoch_id] = start + step * (size - 1);
@@ -132,7 +135,7 @@ PatchIterator::PatchIterator(db_int_t station_id) {
         patch_last = start + step * (size - 1);
     }
 
-    if (r.size() > 0) {
+    if (patch_start >= 0) {
         // Append last patch
         Timestamp t = Timestamp::fromPosixTime(patch_start);
         Interval i = Interval::fromSeconds(patch_step);
@@ -144,7 +147,9 @@ PatchIterator::PatchIterator(db_int_t station_id) {
         m_Patches.append(Patch(t, i, s, epochs));
     }
 
+    m_Samples.resize(m_Patches.size());
     m_CurrentPatch = -1;
+    m_Current = -1;
 }
 
 Patch PatchIterator::data() const {
@@ -152,27 +157,39 @@ Patch PatchIterator::data() const {
     return m_Patches[m_CurrentPatch];
 }
 
+const Timestamp& PatchIterator::start() const {
+    Q_ASSERT(m_CurrentPatch >= 0 && m_CurrentPatch < m_Patches.size());
+    return m_Patches[m_CurrentPatch].start();
+}
+
+const Interval& PatchIterator::step() const {
+    Q_ASSERT(m_CurrentPatch >= 0 && m_CurrentPatch < m_Patches.size());
+    return m_Patches[m_CurrentPatch].step();
+}
+
+db_int_t PatchIterator::size() const {
+    Q_ASSERT(m_CurrentPatch >= 0 && m_CurrentPatch < m_Patches.size());
+    return m_Patches[m_CurrentPatch].size();
+}
+
 
 bool PatchIterator::nextPatch() {
     if (m_CurrentPatch + 1 >= m_Patches.size()) return false;
     m_CurrentPatch += 1;
-    m_CurrentEpoch = 0;
-    m_Step = data().step().seconds;
-    m_CurrentStamp = m_FirstStamp[data().epochs().at(m_CurrentEpoch)] - m_Step;
+    m_Current = -1;
     return true;
 }
 
 bool PatchIterator::lastPatch() {
     if (m_Patches.isEmpty()) return false;
     m_CurrentPatch = m_Patches.size() - 1;
-    m_CurrentEpoch = 0;
-    m_Step = data().step().seconds;
-    m_CurrentStamp = m_FirstStamp[data().epochs().at(m_CurrentEpoch)] - m_Step;
+    m_Current = -1;
     return true;
 }
 
 void PatchIterator::reset() {
     m_CurrentPatch = -1;
+    m_Current = -1;
 }
 
 Timestamp PatchIterator::lastDataPoint() {
@@ -189,60 +206,95 @@ Timestamp PatchIterator::epoch() const {
 
 
 bool PatchIterator::next() {
-    Patch::Epochs epochs = data().epochs();
-    if (m_CurrentEpoch >= epochs.size()) return false;
-    m_CurrentStamp += m_Step;
-    if (m_CurrentStamp > m_LastStamp[epochs.at(m_CurrentEpoch)]) {
-        m_CurrentEpoch += 1;
-    }
-    if (m_CurrentEpoch >= epochs.size()) return false;
+    if (m_Current + 1 >= size()) return false;
+    m_Current += 1;
     return true;
 }
 
 Timestamp PatchIterator::stamp() const {
-    return Timestamp::fromPosixTime(m_CurrentStamp);
+    return Timestamp::fromPosixTime(start().posix() + m_Current * step().seconds);
 }
 
+double PatchIterator::bridge(double last, double first, double x) {
+    return last * (1 - x) + first * x;
+}
 
 double PatchIterator::reading() {
-    Patch::Epochs epochs = data().epochs();
-    qint64 epoch_id = epochs[m_CurrentEpoch];
+    return samples()[m_Current];
+}
 
-    if (m_Readings[epoch_id].isEmpty()) {
-        getReadings();
+Samples PatchIterator::samples() {
+    Q_ASSERT(m_CurrentPatch >= 0 && m_CurrentPatch < m_Patches.size());
+    bool last = m_CurrentPatch == m_Patches.size() - 1;
+    if (last && m_Cache) {
+        return Samples(m_Cache->data(), m_Cache->size());
     }
-
-    if (m_CurrentStamp < m_FirstStamp[epoch_id]) {
-        Q_ASSERT(m_CurrentEpoch > 0);
-        qDebug() << "between patches: linear interpolation";
-        db_int_t prev_id = epochs[m_CurrentEpoch - 1];
-        double delta = m_CurrentStamp - m_LastStamp[prev_id];
-        //  m_LastStamp[prev_id] < m_CurrentStamp < m_FirstStamp[epoch_id]
-        Q_ASSERT(delta > 0);
-        double x = delta / (m_FirstStamp[epoch_id] - m_LastStamp[prev_id]);
-        return m_Readings[epoch_id].first() * (1 - x) + m_Readings[prev_id].last() * x;
+    if (m_Samples.at(m_CurrentPatch).isEmpty()) {
+        if (last) {
+            m_Cache = SampleCache::Open(m_Station, m_Patches[m_CurrentPatch]);
+            if (m_Cache) {
+                return Samples(m_Cache->data(), m_Cache->size());
+            }
+        }
+        materialize();
+        if (last) {
+            SampleCache::Write(m_Station, m_Patches[m_CurrentPatch], m_Samples.at(m_CurrentPatch));
+        }
     }
+    const QVector<double>& s = m_Samples.at(m_CurrentPatch);
+    return Samples(s.constData(), s.size());
+}
+
+void PatchIterator::materialize() {
+    const Patch& p = m_Patches[m_CurrentPatch];
+    const Patch::Epochs& epochs = p.epochs();
 
-    qint64 delta = m_CurrentStamp - m_FirstStamp[epoch_id];
-    qint64 step = m_Steps[epoch_id];
-    qint64 index = delta / step;
-    if (delta % step == 0) {
-        return m_Readings[epoch_id][index];
+    QVector<QVector<double>> readings(epochs.size());
+    for (int e = 0; e < epochs.size(); e++) {
+        readings[e] = Readings::Load(epochs[e]);
     }
 
-    // linear interpolation
-    double x = double (delta % step) / step;
-    return m_Readings[epoch_id][index] * (1 - x) + m_Readings[epoch_id][index + 1] * x;
-}
+    QVector<double> samples(p.size());
+    db_int_t stamp = p.start().posix();
+    db_int_t step = p.step().seconds;
+    int e = 0;
+    for (db_int_t k = 0; k < p.size(); k++, stamp += step) {
+        while (e + 1 < epochs.size() && (stamp > m_LastStamp[epochs[e]] || readings[e].isEmpty())) {
+            e += 1;
+        }
+        db_int_t epoch_id = epochs[e];
+        const QVector<double>& r = readings[e];
+        if (r.isEmpty()) {
+            qDebug() << "no readings for epoch" << epoch_id;
+            samples[k] = k > 0 ? samples[k - 1] : 0;
+            continue;
+        }
 
-void PatchIterator::getReadings() {
-    Patch::Epochs epochs = data().epochs();
-    qint64 epoch_id = epochs[m_CurrentEpoch];
+        db_int_t first = m_FirstStamp[epoch_id];
+        if (stamp < first) {
+            if (e == 0 || readings[e - 1].isEmpty()) {
+                samples[k] = r.first();
+                continue;
+            }
+            // between epochs: linear interpolation
+            db_int_t last = m_LastStamp[epochs[e - 1]];
+            double x = double(stamp - last) / (first - last);
+            samples[k] = bridge(readings[e - 1].last(), r.first(), x);
+            continue;
+        }
 
-    QVariantList vars;
-    vars << epoch_id;
-    QList<QVector<QVariant>> raw = Database::Query("select reading from readings where epoch_id=?", vars);
-    foreach (QVector<QVariant> v, raw) {
-        m_Readings[epoch_id].append(v[0].toDouble());
+        db_int_t delta = stamp - first;
+        db_int_t estep = m_Steps[epoch_id];
+        db_int_t index = delta / estep;
+        if (index + 1 >= r.size()) {
+            samples[k] = r.last();
+            continue;
+        }
+        // linear interpolation, exact on the grid of the epoch
+        double x = double(delta % estep) / estep;
+        samples[k] = r[index] * (1 - x) + r[index + 1] * x;
     }
+
+    m_Samples[m_CurrentPatch] = samples;
 }
+
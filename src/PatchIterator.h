@@ -1,10 +1,12 @@
 #ifndef PATCHITERATOR_H
 #define PATCHITERATOR_H
 
+#include <algorithm>
 #include <QVector>
 
 #include "Timestamp.h"
 #include "Database.h"
+#include "SampleCache.h"
 
 namespace Tide {
 
@@ -45,6 +47,24 @@ private:
 
 typedef QVector<Patch> PatchData;
 
+// Read only view of contiguous samples
+class Samples {
+public:
+    Samples(const double* data = 0, db_int_t size = 0): m_Data(data), m_Size(size) {}
+    const double* constData() const {return m_Data;}
+    db_int_t size() const {return m_Size;}
+    bool isEmpty() const {return m_Size == 0;}
+    double operator[] (db_int_t k) const {return m_Data[k];}
+    QVector<double> toVector() const {
+        QVector<double> v(m_Size);
+        std::copy(m_Data, m_Data + m_Size, v.begin());
+        return v;
+    }
+private:
+    const double* m_Data;
+    db_int_t m_Size;
+};
+
 class PatchIterator {
 
 public:
@@ -59,25 +79,38 @@ public:
     Timestamp stamp() const;
     double reading();
 
+    // Readings of the current patch resampled to its step, gaps between
+    // epochs bridged by linear interpolation. Built once per patch, the
+    // last patch is served from the SampleCache file when it is current.
+    // Index k is at start() + k * step().
+    Samples samples();
+    const Timestamp& start() const;
+    const Interval& step() const;
+    db_int_t size() const;
+
+    // Value at x in [0, 1] on the line from the last reading of an epoch
+    // to the first reading of the next one
+    static double bridge(double last, double first, double x);
+
     ~PatchIterator() {}
 
 private:
 
-    void getReadings();
+    void materialize();
 
 private:
 
+    db_int_t m_Station;
     int m_CurrentPatch;
-    db_int_t m_CurrentStamp;
-    db_int_t m_Step;
-    int m_CurrentEpoch;
+    db_int_t m_Current;
 
     PatchData m_Patches;
+    QVector<QVector<double>> m_Samples; // per patch
+    SampleCache::Ptr m_Cache; // last patch
 
     QMap<db_int_t, db_int_t> m_FirstStamp;
     QMap<db_int_t, db_int_t> m_LastStamp;
     QMap<db_int_t, db_int_t> m_Steps;
-    QMap<db_int_t, QVector<double>> m_Readings;
 
 
 };
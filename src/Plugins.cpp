@@ -0,0 +1,90 @@
+#include "Plugins.h"
+#include <QPluginLoader>
+#include <QDir>
+#include <QDebug>
+
+using namespace Tide;
+
+static const char* iid = "net.kvanttiapina.tide.StationFactory/2.0";
+
+
+Plugins::Plugins(const QString& dir) {
+    foreach (QStaticPlugin plugin, QPluginLoader::staticPlugins()) {
+        Entry e;
+        e.create = plugin.instance;
+        add(e, plugin.metaData());
+    }
+
+    QDir pluginsDir(dir);
+    foreach (QString fileName, pluginsDir.entryList(QDir::Files)) {
+        Entry e;
+        e.loader = new QPluginLoader(pluginsDir.absoluteFilePath(fileName));
+        if (!add(e, e.loader->metaData())) delete e.loader;
+    }
+}
+
+// Reads the factory info from the metadata; plugins without one are
+// loaded right away to ask the factory itself.
+bool Plugins::add(Entry& e, const QJsonObject& meta) {
+    if (meta.value("IID").toString() != iid) return false;
+
+    QJsonObject data = meta.value("MetaData").toObject();
+    e.info = StationFactoryInfo(data.value("key").toString());
+    e.info.name = data.value("name").toString();
+    e.info.logo = data.value("logo").toString();
+    e.info.about = data.value("about").toString();
+    e.info.home = data.value("home").toString();
+
+    m_Entries.append(e);
+    if (e.info.key.isEmpty()) {
+        qDebug() << "Plugins: no metadata, loading";
+        if (!instance(m_Entries.size() - 1)) {
+            m_Entries.removeLast();
+            return false;
+        }
+    }
+    return true;
+}
+
+Plugins::~Plugins() {
+    foreach (const Entry& e, m_Entries) {
+        delete e.loader;
+    }
+}
+
+int Plugins::size() const {
+    return m_Entries.size();
+}
+
+const StationFactoryInfo& Plugins::info(int k) const {
+    return m_Entries[k].info;
+}
+
+StationFactory* Plugins::instance(int k) {
+    if (k < 0 || k >= m_Entries.size()) return 0;
+    Entry& e = m_Entries[k];
+    if (e.factory) return e.factory;
+
+    QObject* plugin = e.create ? e.create() : e.loader->instance();
+    e.factory = qobject_cast<StationFactory*>(plugin);
+    if (!e.factory) {
+        qDebug() << "Plugins: cannot load" << e.info.key << (e.loader ? e.loader->errorString() : QString());
+        return 0;
+    }
+    qDebug() << "Plugins: loaded" << e.factory->info().key;
+    e.info = e.factory->info();
+    return e.factory;
+}
+
+bool Plugins::loaded(int k) const {
+    return m_Entries[k].factory != 0;
+}
+
+QList<StationFactory*> Plugins::instances() {
+    QList<StationFactory*> factories;
+    for (int k = 0; k < m_Entries.size(); k++) {
+        StationFactory* factory = instance(k);
+        if (factory) factories.append(factory);
+    }
+    return factories;
+}
@@ -0,0 +1,54 @@
+#ifndef TIDE_PLUGINS_H
+#define TIDE_PLUGINS_H
+
+#include <QList>
+#include <QString>
+#include <QJsonObject>
+
+#include "StationFactory.h"
+
+class QPluginLoader;
+
+namespace Tide {
+
+// Station factory plugins, the static ones and those in the plugins
+// directory. They are listed from their metadata and the factory is
+// instantiated when it is first asked for.
+class Plugins {
+public:
+
+    Plugins(const QString& dir);
+    ~Plugins();
+
+    int size() const;
+    const StationFactoryInfo& info(int k) const;
+    StationFactory* instance(int k);
+    bool loaded(int k) const;
+    // instantiates all of them
+    QList<StationFactory*> instances();
+
+private:
+
+    Plugins(const Plugins&);
+    Plugins& operator=(const Plugins&);
+
+    class Entry {
+    public:
+        Entry(): create(0), loader(0), factory(0) {}
+        StationFactoryInfo info;
+        QObject* (*create)(); // static plugin
+        QPluginLoader* loader;
+        StationFactory* factory;
+    };
+
+    bool add(Entry& e, const QJsonObject& meta);
+
+private:
+
+    QList<Entry> m_Entries;
+
+};
+
+}
+
+#endif // TIDE_PLUGINS_H
@@ -19,6 +19,8 @@
 
 #include <QMouseEvent>
 #include <QApplication>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 #include <fftw3.h>
 
 using namespace Tide;
@@ -37,9 +39,10 @@ PointsWindow::PointsWindow(const Address& addr, const Station& station):
     PatchIterator points(station_id);
 
     if (points.lastPatch()) {
-        while (points.next()) {
-            stamps.append(points.stamp());
-            orig.append(points.reading());
+        orig = points.samples().toVector();
+        stamps.reserve(orig.size());
+        for (int k = 0; k < orig.size(); k++) {
+            stamps.append(points.start() + Interval::fromSeconds(k * points.step().seconds));
         }
     }
 
@@ -48,7 +51,7 @@ PointsWindow::PointsWindow(const Address& addr, const Station& station):
         gen.append(v.value);
     }
 
-    QString stationName = Database::StationInfo(addr, "name");
+    QString stationName = Database::Info(addr).name;
 
     addWidget(new TimeDomain(stationName, stamps, orig, gen));
     addWidget(new FrequencyDomain(stationName, stamps, orig, gen));
@@ -60,30 +63,42 @@ PointsWindow::PointsWindow(int station_id):
 {
 
     QVector<double> orig;
-    QVector<double> gen;
     QVector<Timestamp> stamps;
 
     PatchIterator points(station_id);
 
     if (points.lastPatch()) {
-        while (points.next()) {
-            stamps.append(points.stamp());
-            orig.append(points.reading());
+        orig = points.samples().toVector();
+        stamps.reserve(orig.size());
+        for (int k = 0; k < orig.size(); k++) {
+            stamps.append(points.start() + Interval::fromSeconds(k * points.step().seconds));
         }
     }
 
-    Tide::RunningSet* rset = Tide::HarmonicsCreator::CreateConstituents(station_id);
-
-
-    foreach (Timestamp t, stamps) {
-        Amplitude v = rset->datum() + rset->tideDerivative(t, 0);
-        gen.append(v.value);
-    }
-
     QString stationName = QString("Station %1").arg(station_id);
 
-    addWidget(new TimeDomain(stationName, stamps, orig, gen));
-    addWidget(new FrequencyDomain(stationName, stamps, orig, gen));
+    // the fit runs on a worker, the graphs are added when it is done
+    QFutureWatcher<RunningSet*>* watcher = new QFutureWatcher<RunningSet*>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [=] () {
+        RunningSet* rset = watcher->result();
+        watcher->deleteLater();
+        QVector<double> gen;
+        if (!rset) {
+            qDebug() << stationName << ": fit failed";
+            gen.fill(0, stamps.size());
+        } else {
+            foreach (Timestamp t, stamps) {
+                Amplitude v = rset->datum() + rset->tideDerivative(t, 0);
+                gen.append(v.value);
+            }
+            delete rset;
+        }
+        addWidget(new TimeDomain(stationName, stamps, orig, gen));
+        addWidget(new FrequencyDomain(stationName, stamps, orig, gen));
+    });
+    watcher->setFuture(QtConcurrent::run([station_id] () {
+        return HarmonicsCreator::CreateConstituents(station_id);
+    }));
 }
 
 
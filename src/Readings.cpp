@@ -0,0 +1,83 @@
+#include <QDebug>
+
+#include "Readings.h"
+
+using namespace Tide;
+
+// Called by the schema migration, inside its transaction
+bool Readings::PackLegacy() {
+    QList<QVector<QVariant>> r;
+    r = Database::Query("select name from sqlite_master where type='table' and name='readings'");
+    if (r.isEmpty()) return true;
+
+    qDebug() << "packing readings";
+    QList<QVector<QVariant>> epochs = Database::Query("select distinct epoch_id from readings");
+    foreach (QVector<QVariant> e, epochs) {
+        QVariantList vars;
+        vars << e[0];
+        r = Database::Query("select reading from readings where epoch_id=? order by id", vars);
+        QVector<double> levels(r.size());
+        for (int i = 0; i < r.size(); i++) {
+            levels[i] = r[i][0].toDouble();
+        }
+        if (!Store(e[0].toLongLong(), levels)) return false;
+    }
+    return Database::Control("drop table readings");
+}
+
+QVector<double> Readings::Load(db_int_t epoch_id) {
+    QVariantList vars;
+    vars << epoch_id;
+    Database::Cursor r = Database::Select("select count, data from epoch_readings where epoch_id=?", vars);
+    if (!r.next()) return QVector<double>();
+    return Decode(r.toByteArray(1), r.toInt(0));
+}
+
+bool Readings::Store(db_int_t epoch_id, const QVector<double>& levels) {
+    QVariantList vars;
+    vars << epoch_id << levels.size() << Encode(levels);
+    return Database::Control("insert or replace into epoch_readings (epoch_id, count, data) values (?, ?, ?)", vars);
+}
+
+QByteArray Readings::Encode(const QVector<double>& levels) {
+    QByteArray raw;
+    raw.reserve(levels.size() * 2);
+    qint64 prev = 0;
+    foreach (double level, levels) {
+        qint64 mm = qRound64(level * 1000);
+        qint64 d = mm - prev;
+        prev = mm;
+        quint64 z = (quint64(d) << 1) ^ quint64(d >> 63);
+        while (z >= 0x80) {
+            raw.append(char(z | 0x80));
+            z >>= 7;
+        }
+        raw.append(char(z));
+    }
+    return qCompress(raw);
+}
+
+QVector<double> Readings::Decode(const QByteArray& blob, int count) {
+    QByteArray raw = qUncompress(blob);
+    QVector<double> levels;
+    levels.reserve(count);
+    const uchar* p = reinterpret_cast<const uchar*>(raw.constData());
+    const uchar* end = p + raw.size();
+    qint64 mm = 0;
+    while (p < end && levels.size() < count) {
+        quint64 z = 0;
+        int shift = 0;
+        while (p < end && (*p & 0x80)) {
+            z |= quint64(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        if (p == end) break;
+        z |= quint64(*p++) << shift;
+        mm += qint64(z >> 1) ^ -qint64(z & 1);
+        levels.append(mm / 1000.);
+    }
+    if (levels.size() != count) {
+        qDebug() << "corrupt readings blob:" << levels.size() << "of" << count << "readings";
+    }
+    return levels;
+}
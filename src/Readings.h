@@ -0,0 +1,29 @@
+#ifndef TIDE_READINGS_H
+#define TIDE_READINGS_H
+
+#include <QVector>
+#include <QByteArray>
+
+#include "Database.h"
+
+namespace Tide {
+
+// Storage of the readings of an epoch as a single blob: levels are rounded
+// to millimetres, delta encoded as zigzag varints and compressed.
+class Readings {
+public:
+
+    // one row per reading, the format before packed blobs
+    static bool PackLegacy();
+
+    static QVector<double> Load(db_int_t epoch_id);
+    static bool Store(db_int_t epoch_id, const QVector<double>& levels);
+
+    static QByteArray Encode(const QVector<double>& levels);
+    static QVector<double> Decode(const QByteArray& blob, int count);
+
+};
+
+}
+
+#endif // TIDE_READINGS_H
@@ -35,6 +35,11 @@ Amplitude RunningSet::tideDerivativeMax(unsigned deriv) const {
 
 RunningSet::~RunningSet() {}
 
+qint64 RunningSet::bytes() const {
+    // QList holds large types through pointers
+    return sizeof(RunningSet) + m_Constituents.size() * (sizeof(Data) + sizeof(void*));
+}
+
 void RunningSet::append(const Amplitude& a, const Speed& w, const Angle& p) {
     m_Constituents.append(Data(a, w, p));
 }
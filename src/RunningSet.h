@@ -27,6 +27,9 @@ public:
     void append(const Amplitude& a, const Speed& w, const Angle& phase);
     void append(const Complex& c, const Speed& w);
 
+    // approximate heap footprint
+    qint64 bytes() const;
+
 private:
 
     class Data {
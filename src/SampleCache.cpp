@@ -0,0 +1,132 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDebug>
+
+#include "SampleCache.h"
+#include "PatchIterator.h"
+
+using namespace Tide;
+
+// File layout, native byte order: Header, qint64 sources[nepochs][3] with
+// the epoch id, the reading count and the size of the readings blob,
+// double samples[count]. Everything stays 8 byte aligned.
+class Header {
+public:
+    quint32 magic;
+    quint32 version;
+    qint64 start;
+    qint64 step;
+    qint64 count;
+    qint64 nepochs;
+};
+
+static const quint32 Magic = 0x53444954; // "TIDS"
+static const quint32 Version = 3;
+
+static bool enabled = true;
+
+void SampleCache::SetEnabled(bool e) {
+    enabled = e;
+}
+
+bool SampleCache::Enabled() {
+    return enabled;
+}
+
+QString SampleCache::Path(db_int_t station_id) {
+    // ~/.local/share, next to the database
+    QString loc = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+    return QString("%1/jolla-tide/samples/%2.bin").arg(loc).arg(station_id);
+}
+
+// Readings replaced in place keep their epoch id, their count and blob
+// size tell them apart.
+QVector<qint64> SampleCache::Sources(const Patch& patch) {
+    QVector<qint64> sources;
+    foreach (db_int_t epoch_id, patch.epochs()) {
+        QVariantList vars;
+        vars << epoch_id;
+        Database::Cursor r = Database::Select("select count, length(data) from epoch_readings where epoch_id=?", vars);
+        sources << epoch_id;
+        if (r.next()) {
+            sources << r.toInt(0) << r.toInt(1);
+        } else {
+            sources << 0 << 0;
+        }
+    }
+    return sources;
+}
+
+SampleCache::SampleCache(const QString& path):
+    m_File(path),
+    m_Map(0),
+    m_Data(0),
+    m_Size(0)
+{}
+
+SampleCache::~SampleCache() {
+    if (m_Map) m_File.unmap(m_Map);
+}
+
+SampleCache::Ptr SampleCache::Open(db_int_t station_id, const Patch& patch) {
+    if (!enabled) return Ptr();
+
+    Ptr c(new SampleCache(Path(station_id)));
+    if (!c->m_File.open(QIODevice::ReadOnly)) return Ptr();
+
+    const Patch::Epochs& epochs = patch.epochs();
+    qint64 header = sizeof(Header) + 3 * epochs.size() * sizeof(qint64);
+    qint64 bytes = header + patch.size() * sizeof(double);
+    if (c->m_File.size() != bytes) return Ptr();
+
+    c->m_Map = c->m_File.map(0, bytes);
+    if (!c->m_Map) return Ptr();
+
+    const Header* h = reinterpret_cast<const Header*>(c->m_Map);
+    if (h->magic != Magic || h->version != Version ||
+            h->start != patch.start().posix() || h->step != patch.step().seconds ||
+            h->count != patch.size() || h->nepochs != epochs.size()) {
+        return Ptr();
+    }
+    QVector<qint64> sources = Sources(patch);
+    const qint64* stored = reinterpret_cast<const qint64*>(h + 1);
+    for (int k = 0; k < sources.size(); k++) {
+        if (stored[k] != sources[k]) return Ptr();
+    }
+
+    c->m_Data = reinterpret_cast<const double*>(c->m_Map + header);
+    c->m_Size = patch.size();
+    return c;
+}
+
+void SampleCache::Write(db_int_t station_id, const Patch& patch, const QVector<double>& samples) {
+    if (!enabled) return;
+
+    QString path = Path(station_id);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    Header h;
+    h.magic = Magic;
+    h.version = Version;
+    h.start = patch.start().posix();
+    h.step = patch.step().seconds;
+    h.count = samples.size();
+    h.nepochs = patch.epochs().size();
+
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qDebug() << path << ": cannot write";
+        return;
+    }
+    f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    QVector<qint64> sources = Sources(patch);
+    f.write(reinterpret_cast<const char*>(sources.constData()), sources.size() * sizeof(qint64));
+    f.write(reinterpret_cast<const char*>(samples.constData()), samples.size() * sizeof(double));
+    f.commit();
+}
+
+void SampleCache::Remove(db_int_t station_id) {
+    QFile::remove(Path(station_id));
+}
@@ -0,0 +1,56 @@
+#ifndef TIDE_SAMPLECACHE_H
+#define TIDE_SAMPLECACHE_H
+
+#include <QFile>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "Database.h"
+
+namespace Tide {
+
+class Patch;
+
+// Resampled readings of the last patch of a station in a file of its own,
+// memory mapped on use. The header records the patch geometry and the
+// source epochs with the count and stored size of their readings; a file
+// that does not match the current patch is ignored and rewritten.
+class SampleCache {
+public:
+
+    typedef QSharedPointer<SampleCache> Ptr;
+
+    static void SetEnabled(bool enabled);
+    static bool Enabled();
+
+    // null unless the cache file of the station matches patch
+    static Ptr Open(db_int_t station_id, const Patch& patch);
+    static void Write(db_int_t station_id, const Patch& patch, const QVector<double>& samples);
+    static void Remove(db_int_t station_id);
+
+    const double* data() const {return m_Data;}
+    db_int_t size() const {return m_Size;}
+
+    ~SampleCache();
+
+private:
+
+    SampleCache(const QString& path);
+    SampleCache(const SampleCache&);
+    SampleCache& operator=(const SampleCache&);
+
+    static QString Path(db_int_t station_id);
+    static QVector<qint64> Sources(const Patch& patch);
+
+private:
+
+    QFile m_File;
+    uchar* m_Map;
+    const double* m_Data;
+    db_int_t m_Size;
+
+};
+
+}
+
+#endif // TIDE_SAMPLECACHE_H
@@ -0,0 +1,75 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QDebug>
+
+#include "Snapshot.h"
+
+using namespace Tide;
+
+static const quint32 Magic = 0x50414e53; // "SNAP"
+static const quint32 Version = 1;
+
+QString Snapshot::Path() {
+    // ~/.local/share, next to the database
+    QString loc = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+    return QString("%1/jolla-tide/snapshot.bin").arg(loc);
+}
+
+Snapshot::Rows Snapshot::Load() {
+    Rows rows;
+    QFile f(Path());
+    if (!f.open(QIODevice::ReadOnly)) return rows;
+
+    QDataStream in(&f);
+    quint32 magic, version, count;
+    in >> magic >> version >> count;
+    if (magic != Magic || version != Version) return rows;
+
+    for (quint32 k = 0; k < count && in.status() == QDataStream::Ok; k++) {
+        Row row;
+        quint32 nevents;
+        in >> row.key >> row.name >> row.level >> nevents;
+        for (quint32 e = 0; e < nevents && in.status() == QDataStream::Ok; e++) {
+            TideEvent ev;
+            qint64 time;
+            qint32 type, L, T;
+            in >> time >> type >> ev.level.value >> L >> T;
+            ev.time = Timestamp::fromPosixTime(time);
+            ev.type = TideEvent::Type(type);
+            ev.level.L = L;
+            ev.level.T = T;
+            row.events.append(ev);
+        }
+        rows.append(row);
+    }
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << f.fileName() << ": truncated";
+        return Rows();
+    }
+    return rows;
+}
+
+void Snapshot::Save(const Rows& rows) {
+    QString path = Path();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qDebug() << path << ": cannot write";
+        return;
+    }
+
+    QDataStream out(&f);
+    out << Magic << Version << quint32(rows.size());
+    foreach (const Row& row, rows) {
+        out << row.key << row.name << row.level << quint32(row.events.size());
+        foreach (const TideEvent& ev, row.events) {
+            out << qint64(ev.time.posix()) << qint32(ev.type) << ev.level.value
+                << qint32(ev.level.L) << qint32(ev.level.T);
+        }
+    }
+    f.commit();
+}
@@ -0,0 +1,40 @@
+#ifndef TIDE_SNAPSHOT_H
+#define TIDE_SNAPSHOT_H
+
+#include <QString>
+#include <QList>
+
+#include "TideEvent.h"
+
+namespace Tide {
+
+// What the active stations showed when the application last ran. The first
+// frame is rendered from it while the stations load in the background.
+class Snapshot {
+public:
+
+    // upcoming events kept per station, as many as the cover shows
+    static const int EventCount = 3;
+
+    class Row {
+    public:
+        QString key;
+        QString name;
+        QString level;
+        QList<TideEvent> events;
+    };
+
+    typedef QList<Row> Rows;
+
+    static Rows Load();
+    static void Save(const Rows& rows);
+
+private:
+
+    static QString Path();
+
+};
+
+}
+
+#endif // TIDE_SNAPSHOT_H
@@ -4,9 +4,11 @@
 #include <QtPlugin>
 #include <QString>
 #include <QList>
-#include <QDomDocument>
+#include <QHash>
+#include <QStringList>
 
 #include "Station.h"
+#include "StationInfo.h"
 
 namespace Tide {
 
@@ -24,26 +26,6 @@ public:
 };
 
 
-class StationInfo {
-
-public:
-
-    StationInfo(const QString& k, const QString& xml): key(k) {
-        info.setContent(xml);
-    }
-
-    StationInfo(const QString& k, const QDomDocument& doc): key(k), info(doc) {}
-    StationInfo() {}
-
-    QString key;
-    QDomDocument info;
-};
-
-
-// alias
-typedef StationInfo StationFactoryInfo;
-
-
 class ClientProxy
 {
 
@@ -66,7 +48,17 @@ public:
 
     virtual const StationFactoryInfo& info() = 0;
     virtual const QHash<QString, StationInfo>& available() = 0;
+    // one entry of available(), without loading all of them
+    virtual StationInfo stationInfo(const QString& station) = 0;
+    // placeholder until ready(), a miss starts instantiate()
     virtual const Station& instance(const QString& station) = 0;
+    // Non-blocking instance: the constituents are fitted in the background
+    // and the client is told when instance() can return the station.
+    virtual bool ready(const QString& station) = 0;
+    virtual void instantiate(const QString& station, ClientProxy* client) = 0;
+    // stations kept loaded regardless of the cache limit
+    virtual void pin(const QStringList& stations) = 0;
+    virtual void preload(const QStringList& stations) = 0;
     virtual void update(const QString& station, ClientProxy* client) = 0;
     virtual bool updateNeeded(const QString& station) = 0;
     virtual void updateAvailable(ClientProxy* client) = 0;
@@ -80,7 +72,7 @@ public:
 
 } // namespace Tide
 
-Q_DECLARE_INTERFACE(Tide::StationFactory, "net.kvanttiapina.tide.StationFactory/1.0")
+Q_DECLARE_INTERFACE(Tide::StationFactory, "net.kvanttiapina.tide.StationFactory/2.0")
 
 
 #endif // STATION_FACTORY_H
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cmath>
+#include <QPair>
+
+#include "StationGrid.h"
+
+using namespace Tide;
+
+static const int Rows = 180;
+static const int Columns = 360;
+static const double EarthRadius = 6371.0; // km
+
+StationGrid::StationGrid() {}
+
+void StationGrid::clear() {
+    m_Cells.clear();
+    m_Cell.clear();
+}
+
+int StationGrid::row(double lat) {
+    return qBound(0, int(::floor(lat + 90)), Rows - 1);
+}
+
+int StationGrid::column(double lng) {
+    return qBound(0, int(::floor(lng + 180)), Columns - 1);
+}
+
+double StationGrid::distance(double lat1, double lng1, double lat2, double lng2) {
+    double p1 = lat1 * M_PI / 180.0;
+    double p2 = lat2 * M_PI / 180.0;
+    double dp = p2 - p1;
+    double dl = (lng2 - lng1) * M_PI / 180.0;
+    double a = ::sin(dp / 2) * ::sin(dp / 2) + ::cos(p1) * ::cos(p2) * ::sin(dl / 2) * ::sin(dl / 2);
+    return 2 * EarthRadius * ::asin(::sqrt(qMin(1.0, a)));
+}
+
+void StationGrid::insert(const StationHandle& station, const Coordinates& c) {
+    remove(station);
+    if (!c.valid()) return;
+    int cell = row(c.lat()) * Columns + column(c.lng());
+    m_Cells[cell].append(Entry(station, c.lat(), c.lng()));
+    m_Cell[station] = cell;
+}
+
+bool StationGrid::contains(const StationHandle& station) const {
+    return m_Cell.contains(station);
+}
+
+void StationGrid::remove(const StationHandle& station) {
+    if (!m_Cell.contains(station)) return;
+    int cell = m_Cell.take(station);
+    QVector<Entry>& entries = m_Cells[cell];
+    for (int k = 0; k < entries.size(); k++) {
+        if (entries[k].station == station) {
+            entries.remove(k);
+            break;
+        }
+    }
+    if (entries.isEmpty()) m_Cells.remove(cell);
+}
+
+// Visits the cells in square rings around the cell of c. After ring r any
+// station left is at least r degrees of latitude or longitude away, which
+// bounds its distance from below.
+StationHandle::HandleList StationGrid::nearest(const Coordinates& c, int count, double km) const {
+    StationHandle::HandleList stations;
+    if (!c.valid() || count <= 0) return stations;
+
+    int r0 = row(c.lat());
+    int c0 = column(c.lng());
+    double cosLat = ::cos(c.lat() * M_PI / 180.0);
+
+    QVector<QPair<double, StationHandle>> found;
+    for (int r = 0; r <= Columns / 2; r++) {
+        for (int i = qMax(0, r0 - r); i <= qMin(Rows - 1, r0 + r); i++) {
+            // only the left and right cells of the rows inside the ring
+            int step = (i == r0 - r || i == r0 + r || r == 0) ? 1 : 2 * r;
+            for (int j = c0 - r; j <= c0 + r; j += step) {
+                if (j - (c0 - r) >= Columns) continue; // wrapped onto the first column
+                int cell = i * Columns + (j + Columns) % Columns;
+                QHash<int, QVector<Entry>>::const_iterator p = m_Cells.constFind(cell);
+                if (p == m_Cells.constEnd()) continue;
+                foreach (const Entry& e, p.value()) {
+                    double d = distance(c.lat(), c.lng(), e.lat, e.lng);
+                    if (km > 0 && d > km) continue;
+                    found.append(qMakePair(d, e.station));
+                }
+            }
+        }
+        std::sort(found.begin(), found.end());
+        double bound = EarthRadius * ::asin(cosLat * ::sin(qMin(r, 90) * M_PI / 180.0));
+        if (found.size() >= count && found[count - 1].first <= bound) break;
+        if (km > 0 && bound > km) break;
+    }
+
+    for (int k = 0; k < found.size() && k < count; k++) {
+        stations.append(found[k].second);
+    }
+    return stations;
+}
+
+StationHandle::HandleList StationGrid::within(double south, double west, double north, double east) const {
+    StationHandle::HandleList stations;
+    if (south > north) return stations;
+
+    QList<QPair<int, int>> columns;
+    if (west <= east) {
+        columns.append(qMakePair(column(west), column(east)));
+    } else {
+        columns.append(qMakePair(column(west), Columns - 1));
+        columns.append(qMakePair(0, column(east)));
+    }
+
+    for (int i = row(south); i <= row(north); i++) {
+        for (int k = 0; k < columns.size(); k++) {
+            for (int j = columns[k].first; j <= columns[k].second; j++) {
+                QHash<int, QVector<Entry>>::const_iterator p = m_Cells.constFind(i * Columns + j);
+                if (p == m_Cells.constEnd()) continue;
+                foreach (const Entry& e, p.value()) {
+                    if (e.lat < south || e.lat > north) continue;
+                    bool inside = west <= east ? (e.lng >= west && e.lng <= east) : (e.lng >= west || e.lng <= east);
+                    if (inside) stations.append(e.station);
+                }
+            }
+        }
+    }
+    return stations;
+}
@@ -0,0 +1,57 @@
+#ifndef TIDE_STATIONGRID_H
+#define TIDE_STATIONGRID_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+#include "Coordinates.h"
+#include "StationHandle.h"
+
+namespace Tide {
+
+// Stations bucketed by one degree latitude/longitude cells, for nearest
+// station and bounding box queries. Distances are great circle distances
+// in kilometres.
+class StationGrid {
+
+public:
+
+    StationGrid();
+
+    void clear();
+    // replaces the position of the station, invalid coordinates remove it
+    void insert(const StationHandle& station, const Coordinates& c);
+    void remove(const StationHandle& station);
+    bool contains(const StationHandle& station) const;
+
+    // closest first, km > 0 limits the search radius
+    StationHandle::HandleList nearest(const Coordinates& c, int count, double km = 0) const;
+    // west > east crosses the antimeridian
+    StationHandle::HandleList within(double south, double west, double north, double east) const;
+
+    static double distance(double lat1, double lng1, double lat2, double lng2);
+
+private:
+
+    class Entry {
+    public:
+        Entry(const StationHandle& s = StationHandle(), double la = 0, double ln = 0): station(s), lat(la), lng(ln) {}
+        StationHandle station;
+        double lat;
+        double lng;
+    };
+
+    static int row(double lat);
+    static int column(double lng);
+
+private:
+
+    QHash<int, QVector<Entry>> m_Cells; // row * columns + column
+    QHash<StationHandle, int> m_Cell;
+
+};
+
+}
+
+#endif // TIDE_STATIONGRID_H
@@ -0,0 +1,100 @@
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QReadWriteLock>
+
+#include "StationHandle.h"
+#include "Database.h"
+
+using namespace Tide;
+
+namespace {
+
+class Entry {
+public:
+    Entry(const Address& a = Address()): address(a), key(a.key()), stationId(0) {}
+    Address address;
+    QString key;
+    QAtomicInt stationId;
+};
+
+// Entries are never freed, so references to them stay valid without the
+// lock. Entry 0 stands for the invalid handle.
+class Table {
+public:
+    Table() {entries.append(new Entry());}
+    QReadWriteLock lock;
+    QVector<Entry*> entries;
+    QHash<QString, quint32> ids; // by key
+};
+
+Table& table() {
+    static Table* t = new Table();
+    return *t;
+}
+
+const Entry& entry(quint32 id) {
+    Table& t = table();
+    QReadLocker lock(&t.lock);
+    return *t.entries[id];
+}
+
+}
+
+StationHandle StationHandle::intern(const Address& addr) {
+    if (addr.factory.isEmpty() || addr.station.isEmpty()) {
+        return StationHandle();
+    }
+    QString key = addr.key();
+    Table& t = table();
+    {
+        QReadLocker lock(&t.lock);
+        QHash<QString, quint32>::const_iterator it = t.ids.constFind(key);
+        if (it != t.ids.constEnd()) return StationHandle(it.value());
+    }
+    QWriteLocker lock(&t.lock);
+    if (t.ids.contains(key)) return StationHandle(t.ids[key]);
+    quint32 id = t.entries.size();
+    t.entries.append(new Entry(addr));
+    t.ids[key] = id;
+    return StationHandle(id);
+}
+
+StationHandle StationHandle::fromKey(const QString& key) {
+    Table& t = table();
+    {
+        QReadLocker lock(&t.lock);
+        QHash<QString, quint32>::const_iterator it = t.ids.constFind(key);
+        if (it != t.ids.constEnd()) return StationHandle(it.value());
+    }
+    return intern(Address::fromKey(key));
+}
+
+const Address& StationHandle::address() const {
+    return entry(m_Id).address;
+}
+
+const QString& StationHandle::key() const {
+    return entry(m_Id).key;
+}
+
+// Stations are never renumbered, so the id is looked up once
+int StationHandle::stationId() const {
+    if (!isValid()) return 0;
+    Entry& e = const_cast<Entry&>(entry(m_Id));
+    int station_id = e.stationId.load();
+    if (station_id == 0) {
+        station_id = Database::StationID(e.address);
+        e.stationId.store(station_id);
+    }
+    return station_id;
+}
+
+QStringList StationHandle::keys(const HandleList& handles) {
+    QStringList k;
+    foreach (const StationHandle& h, handles) {
+        k.append(h.key());
+    }
+    return k;
+}
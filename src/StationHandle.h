@@ -0,0 +1,57 @@
+#ifndef TIDE_STATIONHANDLE_H
+#define TIDE_STATIONHANDLE_H
+
+#include <QString>
+#include <QList>
+#include <QStringList>
+#include <QMetaType>
+
+#include "Address.h"
+
+namespace Tide {
+
+// A station interned into a process wide table. Handles are compared and
+// hashed as 32-bit integers; the address, its key string and the row id
+// in the database stay in the table. Keys are only built at the QML and
+// D-Bus boundaries.
+class StationHandle {
+
+public:
+
+    StationHandle(): m_Id(0) {}
+
+    static StationHandle intern(const Address& addr);
+    static StationHandle fromKey(const QString& key);
+
+    bool isValid() const {return m_Id != 0;}
+    quint32 id() const {return m_Id;}
+
+    const Address& address() const;
+    const QString& key() const;
+    // id in table stations, 0 if the station is not stored
+    int stationId() const;
+
+    bool operator==(const StationHandle& h) const {return m_Id == h.m_Id;}
+    bool operator!=(const StationHandle& h) const {return m_Id != h.m_Id;}
+    bool operator<(const StationHandle& h) const {return m_Id < h.m_Id;}
+
+    typedef QList<StationHandle> HandleList;
+
+    static QStringList keys(const HandleList& handles);
+
+private:
+
+    explicit StationHandle(quint32 id): m_Id(id) {}
+
+    quint32 m_Id;
+};
+
+inline uint qHash(const StationHandle& h, uint seed = 0) {
+    return qHash(h.id(), seed);
+}
+
+}
+
+Q_DECLARE_METATYPE(Tide::StationHandle)
+
+#endif // TIDE_STATIONHANDLE_H
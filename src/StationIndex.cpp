@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <iterator>
+
+#include "StationIndex.h"
+
+using namespace Tide;
+
+StationIndex::StationIndex() {}
+
+void StationIndex::clear() {
+    m_Stations.clear();
+    m_Text.clear();
+    m_Postings.clear();
+    m_Query.clear();
+    m_Hits.clear();
+}
+
+StationIndex::Gram StationIndex::gram(const QChar* c) {
+    return (Gram(c[0].unicode()) << 32) | (Gram(c[1].unicode()) << 16) | Gram(c[2].unicode());
+}
+
+void StationIndex::add(const StationHandle& station, const StationInfo& info) {
+    int id = m_Stations.size();
+    QStringList attrs;
+    attrs << info.name << info.county << info.country << info.region;
+    QString text = attrs.join('\n').toCaseFolded();
+    m_Stations.append(station);
+    m_Text.append(text);
+
+    for (int i = 0; i + 3 <= text.size(); i++) {
+        const QChar* c = text.constData() + i;
+        if (c[0] == '\n' || c[1] == '\n' || c[2] == '\n') continue;
+        QVector<int>& ids = m_Postings[gram(c)];
+        if (ids.isEmpty() || ids.last() != id) ids.append(id);
+    }
+    // added entries are not in the previous hits
+    m_Query.clear();
+}
+
+QVector<int> StationIndex::candidates(const QString& folded) const {
+    QVector<int> all;
+    if (folded.size() < 3) {
+        all.resize(m_Stations.size());
+        for (int id = 0; id < all.size(); id++) all[id] = id;
+        return all;
+    }
+
+    QList<const QVector<int>*> lists;
+    for (int i = 0; i + 3 <= folded.size(); i++) {
+        QHash<Gram, QVector<int>>::const_iterator p = m_Postings.constFind(gram(folded.constData() + i));
+        if (p == m_Postings.constEnd()) return all;
+        lists.append(&p.value());
+    }
+    std::sort(lists.begin(), lists.end(),
+              [] (const QVector<int>* a, const QVector<int>* b) {return a->size() < b->size();});
+
+    all = *lists.first();
+    for (int k = 1; k < lists.size() && !all.isEmpty(); k++) {
+        QVector<int> common;
+        std::set_intersection(all.constBegin(), all.constEnd(),
+                              lists[k]->constBegin(), lists[k]->constEnd(),
+                              std::back_inserter(common));
+        all = common;
+    }
+    return all;
+}
+
+StationHandle::HandleList StationIndex::search(const QString& query) {
+    QString folded = query.toCaseFolded();
+    QVector<int> ids;
+    if (!m_Query.isEmpty() && folded.contains(m_Query)) {
+        ids = m_Hits;
+    } else {
+        ids = candidates(folded);
+    }
+
+    m_Hits.clear();
+    StationHandle::HandleList stations;
+    foreach (int id, ids) {
+        if (m_Text[id].contains(folded)) {
+            m_Hits.append(id);
+            stations.append(m_Stations[id]);
+        }
+    }
+    m_Query = folded;
+    return stations;
+}
@@ -0,0 +1,49 @@
+#ifndef TIDE_STATIONINDEX_H
+#define TIDE_STATIONINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+#include "StationInfo.h"
+#include "StationHandle.h"
+
+namespace Tide {
+
+// Substring search over name, county, country and region of the stations.
+// The case folded attributes are split into trigrams; a query is answered
+// by intersecting the posting lists of its trigrams and checking the few
+// candidates left. A query that extends the previous one only rechecks
+// the previous hits.
+class StationIndex {
+
+public:
+
+    StationIndex();
+
+    void clear();
+    void add(const StationHandle& station, const StationInfo& info);
+
+    // matching stations, in the order they were added
+    StationHandle::HandleList search(const QString& query);
+
+private:
+
+    typedef quint64 Gram;
+
+    static Gram gram(const QChar* c);
+    QVector<int> candidates(const QString& folded) const;
+
+private:
+
+    QVector<StationHandle> m_Stations;
+    QVector<QString> m_Text; // folded attributes separated by newlines
+    QHash<Gram, QVector<int>> m_Postings; // ascending entry numbers
+    QString m_Query; // folded
+    QVector<int> m_Hits;
+
+};
+
+}
+
+#endif // TIDE_STATIONINDEX_H
@@ -0,0 +1,35 @@
+#include <QStringList>
+#include <QDomDocument>
+#include <QDebug>
+
+#include "StationInfo.h"
+
+using namespace Tide;
+
+StationInfo StationInfo::fromXml(const QString& key, const QString& xml) {
+    StationInfo info(key);
+    QString errMsg;
+    int erow;
+    int ecol;
+    QDomDocument doc(key);
+    if (!doc.setContent(xml, &errMsg, &erow, &ecol)) {
+        qDebug() << key << errMsg << erow << ecol;
+        return info;
+    }
+    QDomElement elem = doc.documentElement();
+    info.name = elem.attribute("name");
+    info.type = elem.attribute("type");
+    info.country = elem.attribute("country");
+    info.county = elem.attribute("county");
+    info.region = elem.attribute("region");
+    info.location = elem.attribute("location");
+    return info;
+}
+
+QString StationInfo::detail() const {
+    QStringList details;
+    if (!county.isEmpty()) details << county;
+    if (!country.isEmpty()) details << country;
+    if (!region.isEmpty()) details << region;
+    return details.join(" / ");
+}
@@ -0,0 +1,47 @@
+#ifndef TIDE_STATIONINFO_H
+#define TIDE_STATIONINFO_H
+
+#include <QString>
+
+namespace Tide {
+
+// Descriptive attributes of a station, stored in columns of the stations
+// table. Plugins hand them over as <station .../> elements, XML is not
+// kept past the import.
+class StationInfo {
+
+public:
+
+    StationInfo(const QString& k = QString()): key(k) {}
+
+    static StationInfo fromXml(const QString& key, const QString& xml);
+
+    // county / country / region, skipping the empty ones
+    QString detail() const;
+
+    QString key;
+    QString name;
+    QString type; // current/master/slave/...
+    QString country;
+    QString county;
+    QString region;
+    QString location; // ISO 6709
+};
+
+
+class StationFactoryInfo {
+
+public:
+
+    StationFactoryInfo(const QString& k = QString()): key(k) {}
+
+    QString key;
+    QString name;
+    QString logo;
+    QString about;
+    QString home;
+};
+
+}
+
+#endif // TIDE_STATIONINFO_H
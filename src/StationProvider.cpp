@@ -1,30 +1,37 @@
 #include "StationProvider.h"
 #include "Address.h"
+#include "Database.h"
+#include <QtConcurrent>
 #include <QDebug>
+#include <QSet>
 
 using namespace Tide;
 
-StationUpdateHandler::StationUpdateHandler(StationProvider* parent, const QString& key):
+StationUpdateHandler::StationUpdateHandler(StationProvider* parent, const StationHandle& station):
     m_Parent(parent),
-    m_Key(key)
+    m_Station(station)
 {}
 
 void StationUpdateHandler::whenFinished(const Status& s) {
     qDebug() << "Tide::StationUpdateHandler::whenFinished" << s.code << s.detail;
     if (s.code == Status::SUCCESS) {
-        QModelIndex c = m_Parent->index(m_Parent->m_Visible.indexOf(m_Key));
+        m_Parent->m_Records.remove(m_Station);
+        if (m_Parent->m_IndexReady) {
+            m_Parent->m_Grid.insert(m_Station, Coordinates::parseISO6709(m_Parent->info(m_Station).location));
+        }
+        QModelIndex c = m_Parent->index(m_Parent->m_Visible.indexOf(m_Station));
         if (c.isValid()) {
             qDebug() << "Tide::StationUpdateHandler: data changed";
             emit m_Parent->dataChanged(c, c);
         } else {
             qDebug() << "Tide::StationUpdateHandler: not visible";
         }
-        emit m_Parent->stationChanged(m_Key);
+        emit m_Parent->stationChanged(m_Station);
     }
 }
 
 ClientProxy* StationUpdateHandler::clone() {
-    return new StationUpdateHandler(m_Parent, m_Key);
+    return new StationUpdateHandler(m_Parent, m_Station);
 }
 
 
@@ -35,29 +42,24 @@ StationProvider::~StationProvider() {}
 StationProvider::StationProvider(Factories* factories, QObject* parent):
     QAbstractListModel(parent),
     m_Factories(factories),
+    m_IndexReady(false),
+    m_Loading(0),
+    m_Reload(false),
     m_Invalid()
 {
     connect(m_Factories, SIGNAL(availableChanged(const QString&)), this, SLOT(resetVisible(const QString&)));
+    connect(m_Factories, SIGNAL(factoryLoaded(const QString&)), this, SLOT(factoryLoaded(const QString&)));
 
     m_Updater = new Update::Manager("net.kvanttiapina.tide", "/Updater", QDBusConnection::sessionBus(), this);
     connect(m_Updater, SIGNAL(ready()), this, SLOT(stationUpdateReady()));
-
-    for (int row = 0; row < m_Factories->rowCount(QModelIndex()); ++row) {
-        StationFactory* factory = m_Factories->instance(row);
-        QString fkey = factory->info().key;
-        const QHash<QString, StationInfo>& stations = factory->available();
-        if (stations.isEmpty()) {
-            m_Factories->update(row);
-            continue;
-        }
-    }
 }
 
 
 void StationProvider::resetVisible(const QString&) {
-    QString filter = m_Filter;
-    m_Filter = ""; // enforce reset
-    setFilter(filter);
+    m_IndexReady = false;
+    if (m_Loading) m_Reload = true;
+    m_Records.clear();
+    updateVisible(search(), true);
 }
 
 int StationProvider::rowCount(const QModelIndex&) const {
@@ -71,40 +73,28 @@ QVariant StationProvider::data(const QModelIndex& index, int role) const {
         return QVariant();
     }
 
-    QString key = m_Visible[index.row()];
+    StationHandle station = m_Visible[index.row()];
 
     if (role == KeyRole) {
-        return key;
+        return station.key();
     }
 
-    Address addr = Address::fromKey(key);
-    StationFactory* factory = m_Factories->instance(addr.factory);
-    QDomElement elem = factory->available()[addr.station].info.documentElement();
+    Record r = record(station);
 
     if (role == NameRole || role == Qt::DecorationRole) {
-        return elem.attribute("name");
+        return r.name;
     }
 
     if (role == DetailRole) {
-        QStringList attrs;
-        attrs << "county" << "country" << "region";
-        QStringList details;
-        foreach (QString attr, attrs) {
-            QString detail = elem.attribute(attr);
-            if (!detail.isEmpty()) {
-                details << detail;
-            }
-        }
-        return details.join(" / ");
+        return r.detail;
     }
 
     if (role == LocationRole) {
-        // Mount Everest +27.5916+086.5640+8850CRSWGS_84/
-        return Coordinates::parseISO6709(elem.attribute("location")).print();
+        return r.location;
     }
 
     if (role == TypeRole) {
-        return elem.attribute("type");
+        return r.kind;
     }
 
 
@@ -121,114 +111,253 @@ QHash<int, QByteArray> StationProvider::roleNames() const {
     return roles;
 }
 
-QDomElement StationProvider::info(const QString& key) {
-    Address addr = Address::fromKey(key);
-    StationFactory* factory = m_Factories->instance(addr.factory);
-    return factory->available()[addr.station].info.documentElement();
+static StationProvider::Record toRecord(const StationInfo& info) {
+    StationProvider::Record r;
+    r.name = info.name;
+    r.detail = info.detail();
+    // Mount Everest +27.5916+086.5640+8850CRSWGS_84/
+    r.location = Coordinates::parseISO6709(info.location).print();
+    r.kind = info.type;
+    return r;
 }
 
-const Station& StationProvider::station(const QString& key) {
-    Address addr = Address::fromKey(key);
+// info and record come from the stations table, the plugins are loaded
+// only when a station is opened or updated
+StationInfo StationProvider::info(const StationHandle& station) {
+    return Database::Info(station.address());
+}
+
+StationProvider::Record StationProvider::record(const StationHandle& station) const {
+    QHash<StationHandle, Record>::const_iterator it = m_Records.constFind(station);
+    if (it != m_Records.constEnd()) {
+        return it.value();
+    }
+    Record r = toRecord(Database::Info(station.address()));
+    m_Records.insert(station, r);
+    return r;
+}
+
+const Station& StationProvider::station(const StationHandle& station) {
+    const Address& addr = station.address();
     StationFactory* factory = m_Factories->instance(addr.factory);
     if (!factory) return m_Invalid;
-    return factory->instance(addr.station);
+    if (factory->ready(addr.station)) {
+        return factory->instance(addr.station);
+    }
+    // placeholder until the fit is done, then stationChanged is emitted
+    factory->instantiate(addr.station, new StationUpdateHandler(this, station));
+    return m_Invalid;
+}
+
+
+bool StationProvider::ready(const StationHandle& station) {
+    const Address& addr = station.address();
+    int row = m_Factories->row(addr.factory);
+    return m_Factories->loaded(row) && m_Factories->instance(row)->ready(addr.station);
+}
+
+// Factories that are not loaded get their pins when they are
+void StationProvider::pin(const StationHandle::HandleList& stations) {
+    m_Pinned.clear();
+    foreach (StationHandle station, stations) {
+        m_Pinned[station.address().factory].append(station.address().station);
+    }
+    for (int row = 0; row < m_Factories->rowCount(QModelIndex()); ++row) {
+        if (!m_Factories->loaded(row)) continue;
+        StationFactory* factory = m_Factories->instance(row);
+        factory->pin(m_Pinned.value(factory->info().key));
+    }
+}
+
+void StationProvider::factoryLoaded(const QString& factory) {
+    m_Factories->instance(factory)->pin(m_Pinned.value(factory));
 }
 
 
 void StationProvider::setFilter(const QString& fter) {
     if (m_Filter == fter) return;
     m_Filter = fter;
+    updateVisible(search(), false);
+    emit filterChanged(m_Filter);
+}
+
+StationHandle::HandleList StationProvider::search() {
+    if (m_Filter.length() <= 2) {
+        return StationHandle::HandleList();
+    }
+    if (!m_IndexReady) loadCatalogs();
+    // the results follow once the catalogs are read
+    if (!m_IndexReady) return StationHandle::HandleList();
+    return m_Index.search(m_Filter);
+}
 
-    beginResetModel();
-
-    m_Visible.clear();
-
-    QStringList locationUpdate;
-
-    if (m_Filter.length() > 2) {
-        QStringList attrs;
-        attrs << "name" << "county" << "country" << "region" << "location";
-
-
-        for (int i = 0; i < m_Factories->rowCount(QModelIndex()); ++i) {
-            StationFactory* f = m_Factories->instance(i);
-            QHash<QString, StationInfo> stations = f->available();
-            QHashIterator<QString, StationInfo> st(stations);
-
-            while (st.hasNext()) {
-                st.next();
-                QDomElement elem = st.value().info.documentElement();
-                foreach (QString attr, attrs) {
-                    QString detail = elem.attribute(attr);
-                    if (detail.isEmpty()) {
-                        continue;
-                    }
-                    if (detail.contains(m_Filter, Qt::CaseInsensitive)) {
-                        QString key = Address(f->info().key, st.key()).key();
-                        m_Visible.append(key);
-                        QString loc = elem.attribute("location");
-                        if (loc.isEmpty()) {
-                            locationUpdate.append(key);
-                        }
-                        break;
-                    }
-                }
+bool StationProvider::loading() const {
+    return m_Loading != 0;
+}
+
+static StationProvider::Catalog readCatalogs(const QStringList& factories) {
+    StationProvider::Catalog c;
+    foreach (QString fkey, factories) {
+        QHash<Address, StationInfo> stations = Database::AllStations(fkey);
+        if (stations.isEmpty()) c.empty.append(fkey);
+        QHashIterator<Address, StationInfo> st(stations);
+        while (st.hasNext()) {
+            st.next();
+            StationHandle station = StationHandle::intern(st.key());
+            c.index.add(station, st.value());
+            c.grid.insert(station, Coordinates::parseISO6709(st.value().location));
+            c.records.insert(station, toRecord(st.value()));
+        }
+    }
+    return c;
+}
+
+// The catalogs are read from the database on a worker thread, the plugins
+// are not loaded for it.
+void StationProvider::loadCatalogs() {
+    if (m_Loading) return;
+    QStringList factories;
+    for (int row = 0; row < m_Factories->rowCount(QModelIndex()); ++row) {
+        factories.append(m_Factories->info(row).key);
+    }
+    m_Reload = false;
+    m_Loading = new QFutureWatcher<Catalog>(this);
+    connect(m_Loading, SIGNAL(finished()), this, SLOT(catalogReady()));
+    m_Loading->setFuture(QtConcurrent::run(readCatalogs, factories));
+    emit loadingChanged();
+}
+
+void StationProvider::catalogReady() {
+    Catalog c = m_Loading->result();
+    m_Loading->deleteLater();
+    m_Loading = 0;
+    if (m_Reload) {
+        loadCatalogs();
+        return;
+    }
+
+    foreach (QString fkey, c.empty) {
+        m_Factories->update(m_Factories->row(fkey));
+    }
+    m_Index = c.index;
+    m_Grid = c.grid;
+    m_Records = c.records;
+    m_IndexReady = true;
+    emit loadingChanged();
+    updateVisible(search(), false);
+}
+
+// Moves the rows from the current list to the given one with row removals
+// and insertions, so that views keep the delegates of the stations that
+// stay visible. The lists come from the same index and keep its order;
+// if they do not, the model is reset.
+void StationProvider::updateVisible(const StationHandle::HandleList& visible, bool refresh) {
+    QSet<StationHandle> next = visible.toSet();
+    QSet<StationHandle> current = m_Visible.toSet();
+
+    // the kept rows have to be in the same order in both lists
+    bool ordered = true;
+    int j = 0;
+    foreach (StationHandle station, m_Visible) {
+        if (!next.contains(station)) continue;
+        while (j < visible.size() && visible[j] != station) j++;
+        if (j == visible.size()) {
+            ordered = false;
+            break;
+        }
+    }
+
+    if (!ordered) {
+        beginResetModel();
+        m_Visible = visible;
+        endResetModel();
+    } else {
+        // drop runs of rows, from the end to keep the indices valid
+        int last = m_Visible.size() - 1;
+        while (last >= 0) {
+            if (next.contains(m_Visible[last])) {
+                last--;
+                continue;
             }
+            int first = last;
+            while (first > 0 && !next.contains(m_Visible[first - 1])) first--;
+            beginRemoveRows(QModelIndex(), first, last);
+            m_Visible.erase(m_Visible.begin() + first, m_Visible.begin() + last + 1);
+            endRemoveRows();
+            last = first - 1;
+        }
+
+        // m_Visible is now a subsequence of visible, fill in the gaps
+        int row = 0;
+        while (row < visible.size()) {
+            if (row < m_Visible.size() && m_Visible[row] == visible[row]) {
+                row++;
+                continue;
+            }
+            int end = row;
+            while (end < visible.size() && !current.contains(visible[end])) end++;
+            beginInsertRows(QModelIndex(), row, end - 1);
+            for (int k = row; k < end; k++) m_Visible.insert(k, visible[k]);
+            endInsertRows();
+            row = end;
+        }
+
+        if (refresh && !m_Visible.isEmpty()) {
+            emit dataChanged(index(0), index(m_Visible.size() - 1));
         }
     }
 
     // check that we have locations
-    foreach (QString key, locationUpdate) {
-        Address addr = Address::fromKey(key);
+    foreach (StationHandle station, m_Visible) {
+        if (!refresh && current.contains(station)) continue;
+        if (m_Grid.contains(station)) continue;
+        if (!info(station).location.isEmpty()) continue;
+        const Address& addr = station.address();
         StationFactory* factory = m_Factories->instance(addr.factory);
-        factory->updateStationInfo("location", addr.station, new StationUpdateHandler(this, key));
+        factory->updateStationInfo("location", addr.station, new StationUpdateHandler(this, station));
     }
-
-    endResetModel();
-    emit filterChanged(m_Filter);
 }
 
 QString StationProvider::filter() const {return m_Filter;}
 
-
 QString StationProvider::name(const QString& key) {
-    return info(key).attribute("name");
+    return record(StationHandle::fromKey(key)).name;
 }
 
 QString StationProvider::location(const QString& key) {
-    return Coordinates::parseISO6709(info(key).attribute("location")).print();
+    return record(StationHandle::fromKey(key)).location;
 }
 
 QString StationProvider::kind(const QString& key) {
-    return info(key).attribute("type");
+    return record(StationHandle::fromKey(key)).kind;
 }
 
 QString StationProvider::detail(const QString& key) {
-    QStringList attrs;
-    attrs << "county" << "country" << "region";
-    QStringList details;
-    QDomElement elem = info(key);
-    foreach (QString attr, attrs) {
-        QString detail = elem.attribute(attr);
-        if (!detail.isEmpty()) {
-            details << detail;
-        }
-    }
-    return details.join(" / ");
+    return record(StationHandle::fromKey(key)).detail;
 }
 
 QString StationProvider::provider(const QString& key) {
     Address addr = Address::fromKey(key);
-    StationFactory* factory = m_Factories->instance(addr.factory);
-    QDomElement f = factory->info().info.documentElement();
-    return f.attribute("name");
+    int row = m_Factories->row(addr.factory);
+    return row < 0 ? QString() : m_Factories->info(row).name;
 }
 
 QString StationProvider::providerlogo(const QString& key) {
     Address addr = Address::fromKey(key);
-    StationFactory* factory = m_Factories->instance(addr.factory);
-    QDomElement f = factory->info().info.documentElement();
-    return f.attribute("logo");
+    int row = m_Factories->row(addr.factory);
+    return row < 0 ? QString() : m_Factories->info(row).logo;
+}
+
+QStringList StationProvider::nearest(double lat, double lng, int count, double km) {
+    if (!m_IndexReady) loadCatalogs();
+    if (!m_IndexReady) return QStringList();
+    return StationHandle::keys(m_Grid.nearest(Coordinates::fromWGS84LatLong(lat, lng), count, km));
+}
+
+QStringList StationProvider::within(double south, double west, double north, double east) {
+    if (!m_IndexReady) loadCatalogs();
+    if (!m_IndexReady) return QStringList();
+    return StationHandle::keys(m_Grid.within(south, west, north, east));
 }
 
 void StationProvider::stationUpdate() const {
@@ -236,9 +365,10 @@ void StationProvider::stationUpdate() const {
 }
 
 void StationProvider::stationUpdateReady() {
+    // the others have nothing loaded
     for (int row = 0; row < m_Factories->rowCount(QModelIndex()); ++row) {
-        StationFactory* factory = m_Factories->instance(row);
-        factory->reset();
+        if (!m_Factories->loaded(row)) continue;
+        m_Factories->instance(row)->reset();
     }
     emit stationReset();
 }
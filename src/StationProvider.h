@@ -2,8 +2,10 @@
 #define STATION_PROVIDER_H
 
 #include <QAbstractListModel>
-#include <QtXml/QDomDocument>
+#include <QFutureWatcher>
 #include "Factories.h"
+#include "StationIndex.h"
+#include "StationGrid.h"
 #include "stationupdater_interface.h"
 
 namespace Tide {
@@ -12,14 +14,14 @@ class StationProvider;
 
 class StationUpdateHandler: public ClientProxy {
 public:
-    StationUpdateHandler(StationProvider* parent, const QString& key);
+    StationUpdateHandler(StationProvider* parent, const StationHandle& station);
     void whenFinished(const Status&);
     ClientProxy* clone();
 
 private:
 
     StationProvider* m_Parent;
-    QString m_Key;
+    StationHandle m_Station;
 };
 
 
@@ -27,6 +29,7 @@ class StationProvider: public QAbstractListModel
 {
     Q_OBJECT
     Q_PROPERTY(QString filter READ filter WRITE setFilter NOTIFY filterChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
 
 public:
 
@@ -39,6 +42,24 @@ public:
     };
 
 
+    // display strings of a station, shared by the models
+    class Record {
+    public:
+        QString name;
+        QString detail; // County / Country / Region
+        QString location;
+        QString kind;
+    };
+
+    // search structures over the stations table, built off the GUI thread
+    class Catalog {
+    public:
+        StationIndex index;
+        StationGrid grid;
+        QHash<StationHandle, Record> records;
+        QStringList empty; // factories without stations
+    };
+
 public:
 
     // create new provider model
@@ -55,12 +76,19 @@ public:
 
     ~StationProvider();
 
-    QDomElement info(const QString& key);
-    const Station& station(const QString& key);
+    StationInfo info(const StationHandle& station);
+    Record record(const StationHandle& station) const;
+    const Station& station(const StationHandle& station);
+    // instance loaded, station() does not return the placeholder
+    bool ready(const StationHandle& station);
+    // keep the stations loaded, the others may be evicted
+    void pin(const StationHandle::HandleList& stations);
 
 
     QString filter() const;
     void setFilter(const QString& s);
+    // station catalogs are being read for the search
+    bool loading() const;
 
     Q_INVOKABLE QString name(const QString& station);
     Q_INVOKABLE QString location(const QString& station);
@@ -69,6 +97,10 @@ public:
     Q_INVOKABLE QString provider(const QString& station);
     Q_INVOKABLE QString providerlogo(const QString& station);
 
+    // station keys by location, closest first; empty while loading
+    Q_INVOKABLE QStringList nearest(double lat, double lng, int count, double km = 0);
+    Q_INVOKABLE QStringList within(double south, double west, double north, double east);
+
     void stationUpdate() const;
 
 
@@ -77,21 +109,38 @@ public slots:
     void resetVisible(const QString& factory);
     void stationUpdateReady();
 
+private slots:
+
+    void catalogReady();
+    void factoryLoaded(const QString& factory);
+
 
 signals:
 
     void filterChanged(const QString& filter);
-    void stationChanged(const QString& key);
+    void loadingChanged();
+    void stationChanged(const Tide::StationHandle& station);
     void stationReset();
 
 private:
 
-    QList<QString> m_Visible;
+    StationHandle::HandleList m_Visible;
     Factories* m_Factories;
     QString m_Filter;
+    StationIndex m_Index;
+    StationGrid m_Grid;
+    mutable QHash<StationHandle, Record> m_Records; // from the catalog, misses read the database
+    bool m_IndexReady;
+    QFutureWatcher<Catalog>* m_Loading; // catalogs being read
+    bool m_Reload; // the catalogs changed while being read
+    QHash<QString, QStringList> m_Pinned; // by factory
     Station m_Invalid;
     Update::Manager* m_Updater;
 
+    void loadCatalogs();
+    StationHandle::HandleList search();
+    void updateVisible(const StationHandle::HandleList& visible, bool refresh);
+
     friend class StationUpdateHandler;
 
 };
@@ -14,7 +14,7 @@ TideForecast::TideForecast(): WebFactory("tfc",
                                          "Tide Times and Time Charts for the World",
                                          "https://www.tide-forecast.com")
 {
-    m_BaseUrl = m_Info.info.documentElement().attribute("home");
+    m_BaseUrl = m_Info.home;
     m_AvailUrl = QString("%1/locations/nav").arg(m_BaseUrl);
 }
 
@@ -27,11 +27,11 @@ QString TideForecast::stationUrl(const QString& key) {
 }
 
 QString TideForecast::locationUrl(const QString& key) {
-    if (!m_Available.contains(key)) return QString();
-    QDomElement f = m_Available[key].info.documentElement();
-    QString city = f.attribute("name");
+    if (!isAvailable(key)) return QString();
+    StationInfo f = stationInfo(key);
+    QString city = f.name;
     if (city.isEmpty()) return QString();
-    QString country = f.attribute("country");
+    QString country = f.country;
     if (country.isEmpty()) return QString();
     QString url = QString("http://maps.googleapis.com/maps/api/geocode/xml?address=%1,%2").arg(city).arg(country);
     m_KnownLocations[url] = key;
@@ -72,8 +72,9 @@ void TideForecast::handleStationUpdate(const QString &key, ClientProxy *client,
     QVector<Amplitude> points;
     Timestamp expected_stamp;
     Timestamp latest = Timestamp::fromPosixTime(0);
-    if (m_LastDataPoint.contains(key)) {
-        latest = m_LastDataPoint[key];
+    Database::Extent extent = Database::StationExtent(Address(m_Info.key, key));
+    if (extent.isValid()) {
+        latest = extent.last;
     }
     QRegularExpression re("\\[\\d+,\\d+,(\\d+),([+-]?\\d+\\.?\\d*)\\]");
     char buf[512];
@@ -12,7 +12,7 @@ namespace Tide {
 class TideForecast: public WebFactory
 {
     Q_OBJECT
-    Q_PLUGIN_METADATA(IID "net.kvanttiapina.tide.StationFactory/1.0")
+    Q_PLUGIN_METADATA(IID "net.kvanttiapina.tide.StationFactory/2.0" FILE "TideForecast.json")
     Q_INTERFACES(Tide::StationFactory)
 
 public:
@@ -58,6 +58,7 @@ void Updater::sync() {
     m_EmitReady = false;
     m_QueuedRequest = false;
     m_Pending.clear();
+    m_Updated.clear();
     Database::ActiveList actives = Database::ActiveStations();
     foreach (Database::Active ac, actives) {
         if (m_Factories[ac.address.factory]->updateNeeded(ac.address.station)) {
@@ -82,14 +83,27 @@ void Updater::updated(const Address &address, const Status &status) {
     m_Pending.removeAll(address);
     if (status.code == Status::SUCCESS) {
         m_EmitReady = true;
-        // this computes new constituentset (webfactory)
-        const Station& st = m_Factories[address.factory]->instance(address.station);
-        if (st.isvalid()) {
-            qDebug() << st.name() << "is ready";
-        }
+        m_Updated.append(address);
     }
 
     if (m_Pending.isEmpty()) {
+        // this computes new constituentsets (webfactory), stations sharing
+        // the sampling grid are fitted together
+        QMap<QString, QStringList> updated;
+        foreach (Address addr, m_Updated) {
+            updated[addr.factory].append(addr.station);
+        }
+        m_Updated.clear();
+        QMapIterator<QString, QStringList> it(updated);
+        while (it.hasNext()) {
+            it.next();
+            m_Factories[it.key()]->preload(it.value());
+            foreach (QString station, it.value()) {
+                if (m_Factories[it.key()]->ready(station)) {
+                    qDebug() << station << "is ready";
+                }
+            }
+        }
         // UPDATING -> IDLE
         m_State = IDLE;
         if (m_EmitReady) {
@@ -61,6 +61,7 @@ private:
     QTimer* m_Long;
     QTimer* m_Short;
     QList<Address> m_Pending;
+    QList<Address> m_Updated;
 
     friend class UpdaterProxy;
 
@@ -2,44 +2,42 @@
 #include "Database.h"
 #include "RunningSet.h"
 #include "HarmonicsCreator.h"
+#include "Readings.h"
 #include <QVector>
 #include <QUrl>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include <QtConcurrent>
+#include <QSettings>
 #include <QDebug>
 
 using namespace Tide;
 
+static const qint64 defaultCacheLimit = 1024 * 1024;
+
 
 WebFactory::WebFactory(const QString& key, const QString& name, const QString& logo,
                        const QString& desc, const QString& url):
     QObject(),
+    m_LoadedBytes(0),
+    m_CacheLimit(defaultCacheLimit),
     m_Invalid(),
-    m_DLManager(new QNetworkAccessManager(this))
+    m_DLManager(new QNetworkAccessManager(this)),
+    m_Fitter(new QThreadPool(this))
 {
-    Database::Control("create table if not exists epochs ("
-                      "id         integer primary key, "
-                      "station_id integer not null, "
-                      "start      integer not null, "
-                      "timedelta  integer not null, "
-                      "patchsize  integer not null)");
-    Database::Control("create table if not exists readings ("
-                      "id       integer primary key, "
-                      "epoch_id integer not null, "
-                      "reading  real not null)");
-    Database::Control("create table if not exists locations ("
-                      "id         integer primary key, "
-                      "station_id integer not null, "
-                      "location   text not null)");
-
-    QDomDocument doc(name);
-    doc.setContent(QString("<factory/>"));
-    QDomElement f = doc.documentElement();
-    f.setAttribute("name", name);
-    f.setAttribute("logo", logo);
-    f.setAttribute("about", desc);
-    f.setAttribute("home", url);
-    m_Info = StationFactoryInfo(key, doc);
+    m_Fitter->setMaxThreadCount(1);
+    // keep the thread, and its database connection, between fits
+    m_Fitter->setExpiryTimeout(-1);
+
+    // ~/.config/jolla-tide/jolla-tide.ini
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "jolla-tide", "jolla-tide");
+    m_CacheLimit = settings.value("cache/stationBytes", defaultCacheLimit).toLongLong();
+
+    m_Info = StationFactoryInfo(key);
+    m_Info.name = name;
+    m_Info.logo = logo;
+    m_Info.about = desc;
+    m_Info.home = url;
 
     connect(m_DLManager, SIGNAL(finished(QNetworkReply*)), this, SLOT(downloadReady(QNetworkReply*)));
 }
@@ -50,67 +48,223 @@ const StationFactoryInfo& WebFactory::info() {
 
 const QHash<QString, StationInfo>& WebFactory::available() {
     if (m_Available.isEmpty()) {
-        QHashIterator<Address, QString> st(Database::AllStations(m_Info.key));
+        QHashIterator<Address, StationInfo> st(Database::AllStations(m_Info.key));
         while (st.hasNext()) {
             st.next();
-            m_Available[st.key().station] = StationInfo(st.key().station, st.value());
+            m_Available[st.key().station] = st.value();
         }
     }
     return m_Available;
 }
 
+StationInfo WebFactory::stationInfo(const QString& key) {
+    if (!m_Available.isEmpty()) {
+        return m_Available.value(key, StationInfo(key));
+    }
+    return Database::Info(Address(m_Info.key, key));
+}
+
+// While the catalog is not read, the stations table is asked instead.
+bool WebFactory::isAvailable(const QString& key) {
+    if (!m_Available.isEmpty()) {
+        return m_Available.contains(key);
+    }
+    return stationId(key) != 0;
+}
+
+// for fits started by instance(), nobody waits for them
+class IgnoreStatus: public ClientProxy {
+public:
+    void whenFinished(const Status&) {}
+    ClientProxy* clone() {return new IgnoreStatus();}
+};
+
 const Station& WebFactory::instance(const QString& key) {
     if (m_Loaded.contains(key)) {
+        touch(key);
         return *m_Loaded[key];
     }
 
-    if (!m_Available.contains(key)) {
-        return m_Invalid;
+    // never fits on the caller's thread
+    instantiate(key, new IgnoreStatus());
+    return m_Invalid;
+}
+
+bool WebFactory::ready(const QString& key) {
+    return m_Loaded.contains(key);
+}
+
+static RunningSet* fitStation(int station_id) {
+    return HarmonicsCreator::CreateConstituents(station_id);
+}
+
+void WebFactory::instantiate(const QString& key, ClientProxy* client) {
+    if (m_Loaded.contains(key)) {
+        Status s(Status::SUCCESS, "<ok/>");
+        client->whenFinished(s);
+        delete client;
+        return;
     }
 
-    QDomDocument doc = m_Available[key].info;
+    if (!isAvailable(key)) {
+        Status s(Status::ERROR, "<error status='Not available'/>");
+        client->whenFinished(s);
+        delete client;
+        return;
+    }
 
-    QString name = doc.documentElement().attribute("name");
-    QString loc = doc.documentElement().attribute("location", "N/A");
-    qDebug() << name << loc;
+    if (m_Failed.contains(key)) {
+        Status s(Status::ERROR, "<error status='Fit failed'/>");
+        client->whenFinished(s);
+        delete client;
+        return;
+    }
+
+    if (m_Loading.contains(key)) {
+        Status s(Status::PENDING, "<ok status='started'/>");
+        client->whenFinished(s);
+        delete client;
+        return;
+    }
+
+    int station_id = stationId(key);
+    if (station_id == 0) {
+        Status s(Status::ERROR, QString("<error reason='%1 not found'/>").arg(key));
+        client->whenFinished(s);
+        delete client;
+        return;
+    }
 
+    m_Loading[key] = client;
+    QFutureWatcher<RunningSet*>* watcher = new QFutureWatcher<RunningSet*>(this);
+    m_Fits[watcher] = key;
+    connect(watcher, SIGNAL(finished()), this, SLOT(fitReady()));
+    watcher->setFuture(QtConcurrent::run(m_Fitter, fitStation, station_id));
+}
+
+void WebFactory::fitReady() {
+    QFutureWatcher<RunningSet*>* watcher = static_cast<QFutureWatcher<RunningSet*>*>(sender());
+    QString key = m_Fits.take(watcher);
+    RunningSet* rset = watcher->result();
+    watcher->deleteLater();
+    ClientProxy* client = m_Loading.take(key);
+
+    if (!rset) {
+        m_Failed.insert(key);
+        Status s(Status::ERROR, "<error status='Fit failed'/>");
+        client->whenFinished(s);
+        delete client;
+        return;
+    }
+
+    load(key, stationId(key), rset);
+    evict(QSet<QString>() << key);
+
+    Status s(Status::SUCCESS, "<ok/>");
+    client->whenFinished(s);
+    delete client;
+}
+
+void WebFactory::preload(const QStringList& keys) {
+    QHash<int, QString> stations;
+    foreach (QString key, keys) {
+        if (m_Loaded.contains(key) || m_Loading.contains(key) || m_Failed.contains(key) || !isAvailable(key)) continue;
+        int station_id = stationId(key);
+        if (station_id == 0) continue;
+        stations[station_id] = key;
+    }
+    if (stations.isEmpty()) return;
+
+    QHash<int, RunningSet*> rsets = HarmonicsCreator::CreateConstituents(stations.keys());
+    QHashIterator<int, QString> it(stations);
+    while (it.hasNext()) {
+        it.next();
+        RunningSet* rset = rsets.value(it.key(), 0);
+        if (!rset) {
+            m_Failed.insert(it.value());
+            continue;
+        }
+        load(it.value(), it.key(), rset);
+    }
+    // once for the batch, its stations are kept over the older ones
+    evict(stations.values().toSet());
+}
+
+int WebFactory::stationId(const QString& key) {
     QList<QVector<QVariant>> r;
     QVariantList vars;
     vars << QVariant::fromValue(key) << QVariant::fromValue(m_Info.key);
     // qDebug() << key << m_Info.key;
     r = Database::Query("select id from stations where suid=? and fuid=?", vars);
     if (r.isEmpty()) {
-        return m_Invalid;
+        return 0;
     }
+    return r.first()[0].toInt();
+}
 
-    int station_id = r.first()[0].toInt();
+void WebFactory::load(const QString& key, int station_id, RunningSet* rset) {
+    StationInfo info = stationInfo(key);
 
-    RunningSet* rset = HarmonicsCreator::CreateConstituents(station_id);
-    if (!rset) {
-        return m_Invalid;
-    }
+    QString name = info.name;
+    QString loc = info.location.isEmpty() ? QString("N/A") : info.location;
+    qDebug() << name << loc;
 
     m_Loaded[key] = new Station(rset, name, Coordinates::parseISO6709(loc));
-    PatchIterator patches(station_id);
-    m_LastDataPoint[key] = patches.lastDataPoint();
+    m_RecentPos[key] = m_Recent.insert(m_Recent.end(), key);
+    m_Bytes[key] = sizeof(Station) + rset->bytes();
+    m_LoadedBytes += m_Bytes[key];
+}
 
-    return *m_Loaded[key];
+void WebFactory::unload(const QString& key) {
+    if (!m_Loaded.contains(key)) return;
+    delete m_Loaded.take(key);
+    m_Recent.erase(m_RecentPos.take(key));
+    m_LoadedBytes -= m_Bytes.take(key);
+}
 
+void WebFactory::touch(const QString& key) {
+    m_Recent.erase(m_RecentPos[key]);
+    m_RecentPos[key] = m_Recent.insert(m_Recent.end(), key);
+}
+
+void WebFactory::evict(const QSet<QString>& keep) {
+    QLinkedList<QString>::iterator it = m_Recent.begin();
+    while (m_LoadedBytes > m_CacheLimit && it != m_Recent.end()) {
+        QString key = *it++;
+        if (keep.contains(key) || m_Pinned.contains(key)) continue;
+        qDebug() << "evicting" << key;
+        unload(key);
+    }
+}
+
+void WebFactory::setCacheLimit(qint64 bytes) {
+    m_CacheLimit = bytes;
+    evict(QSet<QString>());
+}
+
+void WebFactory::pin(const QStringList& keys) {
+    m_Pinned = keys.toSet();
+    evict(QSet<QString>());
 }
 
 
 bool WebFactory::updateNeeded(const QString& key) {
-    if (!m_Available.contains(key)) {
+    if (!isAvailable(key)) {
         // qDebug() << "updateNeeded false: not available" << key;
         return false;
     }
-    if (!instance(key).isvalid()) {
-        qDebug() << "updateNeeded true: not active" << key;
+    Database::Extent extent = Database::StationExtent(Address(m_Info.key, key));
+    if (!extent.isValid()) {
+        qDebug() << "updateNeeded true: no data" << key;
+        return true;
+    }
+    if (extent.fit == Database::Extent::FAILED) {
+        qDebug() << "updateNeeded true: fit failed" << key;
         return true;
     }
 
-    if (m_LastDataPoint.contains(key) && m_LastDataPoint[key] > Timestamp::now() + Interval::fromSeconds(2*24*3600)) {
-        qDebug() << "updateNeeded false:" << key << "valid until" << m_LastDataPoint[key].print();
+    if (extent.last > Timestamp::now() + Interval::fromSeconds(2*24*3600)) {
+        qDebug() << "updateNeeded false:" << key << "valid until" << extent.last.print();
         return false;
     }
 
@@ -129,7 +283,7 @@ bool WebFactory::updateNeeded(const QString& key) {
 
 
 void WebFactory::update(const QString& key, ClientProxy* client) {
-    if (!m_Available.contains(key)) {
+    if (!isAvailable(key)) {
         Status s(Status::ERROR, "<error status='Not available'/>");
         client->whenFinished(s);
         delete client;
@@ -150,7 +304,7 @@ void WebFactory::update(const QString& key, ClientProxy* client) {
 }
 
 void WebFactory::updateStationInfo(const QString& attr, const QString& key, ClientProxy* client) {
-    if (!m_Available.contains(key)) {
+    if (!isAvailable(key)) {
         Status s(Status::ERROR, "<error status='Not available'/>");
         client->whenFinished(s);
         delete client;
@@ -169,7 +323,7 @@ void WebFactory::updateStationInfo(const QString& attr, const QString& key, Clie
     r = Database::Query("select l.location from locations l join stations s on l.station_id=s.id where s.suid=? and s.fuid=?", vars);
     if (!r.isEmpty()) {
         QString loc = r.first()[0].toString();
-        m_Available[key].info.documentElement().setAttribute("location", loc);
+        if (m_Available.contains(key)) m_Available[key].location = loc;
         Status s(Status::SUCCESS, "<ok/>");
         client->whenFinished(s);
         delete client;
@@ -196,7 +350,11 @@ void WebFactory::reset() {
     }
 
     m_Loaded.clear();
-    m_LastDataPoint.clear();
+    m_Failed.clear();
+    m_Recent.clear();
+    m_RecentPos.clear();
+    m_Bytes.clear();
+    m_LoadedBytes = 0;
 }
 
 void WebFactory::updateAvailable(ClientProxy* client) {
@@ -257,6 +415,7 @@ void WebFactory::storeStation(const QString& key, ClientProxy* client, const QVe
         return;
     }
 
+    Database::Transaction();
     vars.clear();
     vars << QVariant::fromValue(station_id) << QVariant::fromValue(epoch.posix()) <<
             QVariant::fromValue(step.seconds) << QVariant::fromValue(points.size());
@@ -266,6 +425,7 @@ void WebFactory::storeStation(const QString& key, ClientProxy* client, const QVe
     vars << QVariant::fromValue(station_id) << QVariant::fromValue(epoch.posix());
     r = Database::Query("select id from epochs where station_id=? and start=?", vars);
     if (r.size() != 1) {
+        Database::Rollback();
         Status s(Status::ERROR, QString("<error reason='Database error'/>"));
         client->whenFinished(s);
         delete client;
@@ -273,21 +433,19 @@ void WebFactory::storeStation(const QString& key, ClientProxy* client, const QVe
     }
 
     int epoch_id = r.first()[0].toInt();
-    Database::Transaction();
+    QVector<double> levels(points.size());
     for (int i = 0; i < points.size(); ++i) {
-        vars.clear();
-        vars << QVariant::fromValue(epoch_id) << QVariant::fromValue(points[i].value);
-        Database::Control("insert into readings (epoch_id, reading) values (?, ?)", vars);
+        levels[i] = points[i].value;
     }
+    Readings::Store(epoch_id, levels);
+    Database::UpdateExtent(station_id);
     Database::Commit();
 
+    // the sample cache is rewritten by the next fit, on the fitter thread
     // enforce new station instance
     HarmonicsCreator::Delete(station_id);
-    if (m_Loaded.contains(key)) {
-        delete m_Loaded[key];
-        m_Loaded.remove(key);
-        m_LastDataPoint.remove(key);
-    }
+    unload(key);
+    m_Failed.remove(key);
 
     Status s(Status::SUCCESS, QString("<ok/>"));
     client->whenFinished(s);
@@ -300,7 +458,7 @@ void WebFactory::storeAvail(ClientProxy* client, const QHash<QString, QString>&
     Database::Transaction();
     while (st.hasNext()) {
         st.next();
-        Database::UpdateStationInfo(Address(m_Info.key, st.key()), st.value());
+        Database::UpdateStationInfo(Address(m_Info.key, st.key()), StationInfo::fromXml(st.key(), st.value()));
     }
     Database::Commit();
     Status s = last ? Status(Status::SUCCESS, QString("<ok/>")) : Status(Status::PENDING, QString("<ok/>"));
@@ -332,10 +490,8 @@ void WebFactory::storeLocation(const QString& key, ClientProxy* client, const QS
         Database::Control("update locations set location=? where station_id=?", vars);
     }
 
-    m_Available[key].info.documentElement().setAttribute("location", location);
-    vars.clear();
-    vars << QVariant::fromValue(m_Available[key].info.toString()) << QVariant::fromValue(station_id);
-    Database::Control("update stations set xmlinfo=? where id=?", vars);
+    if (m_Available.contains(key)) m_Available[key].location = location;
+    Database::Control("update stations set location=? where id=?", vars);
 
     Status s(Status::SUCCESS, "<ok/>");
     client->whenFinished(s);
@@ -344,5 +500,7 @@ void WebFactory::storeLocation(const QString& key, ClientProxy* client, const QS
 }
 
 
-WebFactory::~WebFactory() {}
+WebFactory::~WebFactory() {
+    m_Fitter->waitForDone();
+}
 
@@ -3,13 +3,18 @@
 
 #include <QObject>
 #include <QNetworkAccessManager>
-#include <QDomDocument>
+#include <QThreadPool>
+#include <QFutureWatcher>
+#include <QSet>
+#include <QLinkedList>
 
 #include "Amplitude.h"
 #include "StationFactory.h"
 
 namespace Tide {
 
+class RunningSet;
+
 class WebFactory : public QObject, public StationFactory
 {
     Q_OBJECT
@@ -20,7 +25,12 @@ public:
 
     const StationFactoryInfo& info();
     const QHash<QString, StationInfo>& available();
+    StationInfo stationInfo(const QString& key);
     const Station& instance(const QString& key);
+    bool ready(const QString& key);
+    void instantiate(const QString& key, ClientProxy* client);
+    void pin(const QStringList& keys);
+    void preload(const QStringList& keys);
     void update(const QString& key, ClientProxy* client);
     bool updateNeeded(const QString& key);
     void updateAvailable(ClientProxy* client);
@@ -29,6 +39,11 @@ public:
 
     ~WebFactory();
 
+    // Loaded stations beyond this many bytes are dropped, least recently
+    // used first, and reloaded from the stored constituents. Read from
+    // cache/stationBytes in the settings, 1 MiB by default.
+    void setCacheLimit(qint64 bytes);
+
 
 protected:
 
@@ -42,19 +57,36 @@ protected:
     void storeAvail(ClientProxy* client, const QHash<QString, QString>& info, bool last=false);
     void storeLocation(const QString& key, ClientProxy* client, const QString& location);
 
+    int stationId(const QString& key);
+    bool isAvailable(const QString& key);
+    void load(const QString& key, int station_id, RunningSet* rset);
+    void unload(const QString& key);
+    void touch(const QString& key);
+    void evict(const QSet<QString>& keep);
+
 protected slots:
 
     void downloadReady(QNetworkReply*);
+    void fitReady();
 
 protected:
 
     StationFactoryInfo m_Info;
-    QHash<QString, StationInfo> m_Available;
+    QHash<QString, StationInfo> m_Available; // empty until read
     QHash<QString, Station*> m_Loaded;
-    QHash<QString, Timestamp> m_LastDataPoint;
+    QLinkedList<QString> m_Recent; // loaded stations, least recently used first
+    QHash<QString, QLinkedList<QString>::iterator> m_RecentPos;
+    QHash<QString, qint64> m_Bytes;
+    qint64 m_LoadedBytes;
+    qint64 m_CacheLimit;
+    QSet<QString> m_Pinned;
     Station m_Invalid;
     QNetworkAccessManager* m_DLManager;
     QHash<QString, ClientProxy*> m_Pending;
+    QThreadPool* m_Fitter; // one thread, keeps its database connection
+    QHash<QString, ClientProxy*> m_Loading;
+    QSet<QString> m_Failed; // not refitted until new data arrives
+    QHash<QFutureWatcher<RunningSet*>*, QString> m_Fits;
 
 };
 